@@ -45,10 +45,12 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 
 #include "nrf.h"
 #include "nordic_common.h"
+#include "app_util.h"
 
 #include "nrfx_log.h"
 #include "nrf_log_ctrl.h"
@@ -59,6 +61,17 @@
 #include "nrfx_temp.h"
 #include "nrfx_clock.h"
 #include "nrfx_rtc.h"
+#include "nrfx_timer.h"
+#include "nrfx_ppi.h"
+#include "nrfx_pwm.h"
+#include "nrf_egu.h"
+
+#include "nrf_atfifo.h"
+#include "nrf_atomic.h"
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_nvmc.h"
+#include "nrf_delay.h"
+#include "pt.h"
 
 #define IN_BUTTON_0 NRF_GPIO_PIN_MAP(0,10)
 #define IN_PROBE_1 NRF_GPIO_PIN_MAP(0,30)
@@ -66,389 +79,5061 @@
 #define OUT_LED_0 NRF_GPIO_PIN_MAP(0,9)
 
 #define CFG_MAIN_LOOP_DELAY_MS 30000
+#define CFG_MAIN_LOOP_PHASE_MS 0
 #define CFG_BUTTON_DEBOUNCE_DELAY_MS 100
 #define CFG_BUTTON_LONG_PRESS_DELAY_MS 5000
+#define CFG_BUTTON_DOUBLE_CLICK_DELAY_MS 300
+#define CFG_BUTTON_REPEAT_DELAY_MS 500
+
+/*
+ * Hardware debounce: button GPIOTE IN event restarts TIMER0 through PPI,
+ * CPU is woken up only when debounce interval is expired
+ */
+#define CFG_BUTTON_DEBOUNCE_HW 1
+
+/*
+ * Input monitor: GPIOTE PORT event of all monitored pins is routed
+ * through PPI to EGU3, whose handler reads IN and LATCH registers once
+ * per wake and generates edge events of changed pins. Buttons are
+ * monitored when hardware debounce is disabled, other pins are set by
+ * port masks (default: P1.01..P1.08, free on DK headers). Monitor is
+ * compiled out when it has no pins.
+ */
+#define CFG_INPUT_MONITOR_ENABLED 1
+#define CFG_INPUT_MONITOR_PINS_P0 0
+#define CFG_INPUT_MONITOR_PINS_P1 0x000001FE
+#define CFG_INPUT_MONITOR_PULL NRF_GPIO_PIN_PULLUP
 #define CFG_PROBE_DEBOUNCE_DELAY_MS 1000
 
+/*
+ * Probe pulse counting: every probe edge is routed through PPI to COUNT
+ * task of own TIMER, pulse rates are calculated every
+ * CFG_PROBE_RATE_PERIOD_MS by virtual timer with no per-edge
+ * interrupts
+ */
+#define CFG_PROBE_COUNTER_MODE 1
+#define CFG_PROBE_RATE_PERIOD_MS 1000
+
+#if CFG_INPUT_MONITOR_ENABLED && !CFG_PROBE_COUNTER_MODE
+#error "Probe interrupt mode uses GPIOTE PORT event owned by input monitor"
+#endif
+
+#if GPIO_COUNT > 1
+#define INPUT_MONITOR_PINS_P1 CFG_INPUT_MONITOR_PINS_P1
+#else
+#define INPUT_MONITOR_PINS_P1 0
+#endif
+
+#define INPUT_MONITOR_USED (CFG_INPUT_MONITOR_ENABLED && \
+        (CFG_INPUT_MONITOR_PINS_P0 || INPUT_MONITOR_PINS_P1 || \
+         !CFG_BUTTON_DEBOUNCE_HW))
+
+/*
+ * SAADC continuous acquisition: RTC2 TICK triggers SAMPLE task through
+ * PPI, EasyDMA fills two alternating buffers, main loop gets every filled
+ * buffer. Sample rate is 8..32768 Hz (RTC2 prescaler).
+ */
+#define CFG_SAADC_CONTINUOUS 1
+#define CFG_SAADC_SAMPLE_RATE_HZ 32
+#define CFG_SAADC_BUFFER_SIZE 16          /* scans per buffer */
+
+/*
+ * SAADC offset is recalibrated in background when die temperature moves
+ * by this delta (0.01 C) since the last calibration
+ */
+#define CFG_SAADC_RECAL_TEMP_DELTA 500
+
+/*
+ * Burst capture of CFG_CAPTURE_INPUT around probe edge, armed by button
+ * short press. Rate is 7813..200000 Hz (SAADC internal timer).
+ */
+#define CFG_CAPTURE_ENABLED 1
+#define CFG_CAPTURE_INPUT NRF_SAADC_INPUT_AIN0
+#define CFG_CAPTURE_RATE_HZ 200000
+#define CFG_CAPTURE_PRE_SAMPLES 768
+#define CFG_CAPTURE_POST_SAMPLES 256
+#define CFG_CAPTURE_ARM_TIMEOUT_MS 10000
+
+#if CFG_CAPTURE_ENABLED && !CFG_PROBE_COUNTER_MODE
+#error "Capture is triggered by IN events of probe counter mode inputs"
+#endif
+
+/*
+ * VDD alarm by SAADC limits of VDD scan channel, band and hysteresis in
+ * mV, limits are re-armed not earlier than CFG_VDD_ALARM_REARM_MS after
+ * an alarm
+ */
+#define CFG_VDD_ALARM_ENABLED 1
+#define CFG_VDD_ALARM_LOW_MV 2000
+#define CFG_VDD_ALARM_HIGH_MV 3500
+#define CFG_VDD_ALARM_HYST_MV 100
+#define CFG_VDD_ALARM_REARM_MS 10000
+
+#if CFG_VDD_ALARM_ENABLED && !CFG_SAADC_CONTINUOUS
+#error "VDD alarm needs continuous SAADC acquisition"
+#endif
+
+/*
+ * Battery state of charge, CFG_SOC_CHEMISTRY is one of
+ * SOC_CHEMISTRY_CR2032, SOC_CHEMISTRY_2XAA_ALKALINE, SOC_CHEMISTRY_LI_SOCL2
+ */
+#define CFG_SOC_ENABLED 1
+#define CFG_SOC_CHEMISTRY SOC_CHEMISTRY_CR2032
+#define CFG_SOC_HYST_PCT 2
+
 #define CFG_LED_FLASH_CYCLE_DELAY_MS 200
 #define CFG_LED_FLASH_DUTY_DELAY_MS 20
 
-#define RTC_COUNTER_FREQUENCY 100
-#define RTC_MS_TO_COUNTER(t) ((t * RTC_INPUT_FREQ / \
-             (RTC_FREQ_TO_PRESCALER(RTC_COUNTER_FREQUENCY) + 1)) / 1000)
+/*
+ * Capacity of ISR to main loop event queue
+ */
+#define CFG_APP_EVT_QUEUE_SIZE 32
+
+/*
+ * Streaming statistics of VDD and temperature with 1 min, 1 h and 1 day
+ * tumbling windows
+ */
+#define CFG_STATS_ENABLED 1
+#define CFG_STATS_EWMA_ALPHA 0.1f
+
+/*
+ * Compressed in-RAM history of VDD and temperature, 128 byte blocks
+ */
+#define CFG_TSERIES_ENABLED 1
+#define CFG_TSERIES_BLOCK_COUNT 32
+
+/*
+ * Persistent log of samples in the last CFG_FLOG_PAGES flash pages,
+ * written by batches of CFG_FLOG_BATCH_RECORDS 8-byte records
+ */
+#define CFG_FLOG_ENABLED 1
+#define CFG_FLOG_PAGES 16
+#define CFG_FLOG_BATCH_RECORDS 8
+
+/*
+ * Maximum number of concurrently running virtual timers
+ */
+#define CFG_VTIMER_MAX 256
+
+/*
+ * Maximum number of scheduler tasks in statistics
+ */
+#define CFG_SCHED_TASK_MAX 16
+
+/*
+ * Maximum number of application jobs, pause between long press dumps
+ */
+#define CFG_JOB_MAX 4
+#define CFG_JOB_REPORT_PAUSE_MS 200
+
+/*
+ * Interrupt handlers latency and duration histograms
+ *
+ * Duration is measured by DWT cycle counter. Latency is measured by
+ * TIMER3, which captures interrupt source event through PPI and handler
+ * entry by CAPTURE task, so it keeps HFCLK running: it is off by default
+ * and enabled for debugging only, duration histograms stay always on.
+ */
+#define CFG_ISR_STATS_ENABLED 1
+#define CFG_ISR_STATS_LATENCY 0
+
+/*
+ * Interrupt priority tiers self-test on long press: load handler
+ * duration, critical section length of the load in CPU cycles and runs
+ * per tier
+ */
+#define CFG_IRQ_SELFTEST_ENABLED 1
+#define CFG_IRQ_SELFTEST_LOAD_US 200
+#define CFG_IRQ_SELFTEST_CS_CYCLES 64
+#define CFG_IRQ_SELFTEST_RUNS 32
+
+/*
+ * RTC counter is 24 bit wide, deadlines on bare counter are compared
+ * modulo counter range and must not be farther than half of range
+ */
+#define RTC_COUNTER_MASK RTC_COUNTER_COUNTER_Msk
+#define RTC_COUNTER_HALF_RANGE ((RTC_COUNTER_MASK + 1) / 2)
+#define RTC_COUNTER_DIFF(a, b) (((a) - (b)) & RTC_COUNTER_MASK)
+
+/*
+ * Minimal distance between counter and compare value which guarantees
+ * COMPARE event generation: compare value COUNTER+1 may not generate the
+ * event and counter may tick once between its read and compare write
+ */
+#define RTC_CC_MIN_DELTA 3
+
+/*
+ * Minimal distance left after compare write, checked by re-reading counter
+ */
+#define RTC_CC_CHECK_DELTA 2
+
+/*
+ * Compare value is not later than counter or too close to it
+ */
+#define RTC_CC_TOO_CLOSE(cc, counter) \
+    ((RTC_COUNTER_DIFF(cc, counter) < RTC_CC_CHECK_DELTA) || \
+     (RTC_COUNTER_DIFF(cc, counter) >= RTC_COUNTER_HALF_RANGE))
 
 const nrfx_rtc_t rtc0 = NRFX_RTC_INSTANCE(0);
 const nrfx_rtc_t rtc1 = NRFX_RTC_INSTANCE(1);
+#if CFG_SAADC_CONTINUOUS
+const nrfx_rtc_t rtc2 = NRFX_RTC_INSTANCE(2);
+#endif
+
+/*
+ * Timebase
+ *
+ * RTC1 runs at 32768 Hz without prescaler and is extended to 64 bits by
+ * count of counter half periods (256 s), which is advanced by CC Channel 1
+ * at half range and by OVRFLW event. Counter MSB is always equal to LSB
+ * of the count unless half period boundary is passed but not handled yet,
+ * then count is corrected by one. So timebase_now() just reads the count
+ * and the counter, without locks or retries, and is safe from any
+ * interrupt priority while RTC1 handler is not delayed for half period.
+ */
+typedef uint64_t timebase_t;
 
+#define TIMEBASE_FREQ RTC_INPUT_FREQ
 
-uint16_t saadc_sample()
+/*
+ * Conversions to ticks are rounded up, so timeouts are never shorter
+ */
+#define TIMEBASE_MS_TO_TICKS(t) \
+        (((uint64_t)(t) * TIMEBASE_FREQ + 999) / 1000)
+#define TIMEBASE_US_TO_TICKS(t) \
+        (((uint64_t)(t) * TIMEBASE_FREQ + 999999) / 1000000)
+#define TIMEBASE_TICKS_TO_MS(t) ((uint64_t)(t) * 1000 / TIMEBASE_FREQ)
+#define TIMEBASE_TICKS_TO_US(t) ((uint64_t)(t) * 1000000 / TIMEBASE_FREQ)
+
+#define TIMEBASE_COUNTER_BITS 24
+#define TIMEBASE_HALF_CC 1
+
+static volatile uint32_t timebase_halves;
+
+static timebase_t timebase_now(void)
 {
-    nrfx_err_t err_code;
-    uint16_t result = 0;
-    const uint8_t saadc_rsolutions[] = { 8, 10, 12, 14 };
+    uint32_t halves = timebase_halves;
+    uint32_t counter = nrfx_rtc_counter_get(&rtc1);
 
-    err_code = nrfx_saadc_sample_convert(0, &result);
-    APP_ERROR_CHECK(err_code);
+    if ((halves & 1) != (counter >> (TIMEBASE_COUNTER_BITS - 1)))
+    {
+        halves++;
+    }
 
-    NRF_LOG_INFO("SAADC: VDD value " NRF_LOG_FLOAT_MARKER " V", 
-            NRF_LOG_FLOAT((float)result * 6.0 * 0.6 /
-                    (1 << saadc_rsolutions[NRFX_SAADC_CONFIG_RESOLUTION])));
-    return result;
+    return ((timebase_t)(halves >> 1) << TIMEBASE_COUNTER_BITS) | counter;
 }
 
-int32_t temp_measure()
+/*
+ * @brief Function for handling half period boundary, called from RTC1
+ * handler on OVRFLW and CC Channel 1 events.
+ */
+static void timebase_half_period(void)
 {
     nrfx_err_t err_code;
-    int32_t result = 0;
 
-    err_code = nrfx_temp_measure();
+    timebase_halves = (uint32_t)(timebase_now() >>
+            (TIMEBASE_COUNTER_BITS - 1));
+
+    /*
+     * Driver disables compare interrupt when it fires
+     */
+    err_code = nrfx_rtc_cc_set(&rtc1, TIMEBASE_HALF_CC,
+            RTC_COUNTER_HALF_RANGE, true);
     APP_ERROR_CHECK(err_code);
-    result = nrfx_temp_calculate(nrfx_temp_result_get());
+}
 
-    NRF_LOG_INFO("TEMP: temperature " NRF_LOG_FLOAT_MARKER " C", 
-            NRF_LOG_FLOAT((float)result / 100));
-    return result;
+#if CFG_BUTTON_DEBOUNCE_HW
+const nrfx_timer_t timer0 = NRFX_TIMER_INSTANCE(0);
+#endif
+
+/*
+ * ISR to main loop event queue
+ *
+ * Interrupt handlers do only time critical work (gesture state machine,
+ * RTC compare reprogramming) and push compact event records to
+ * lock-free queue. Logging and application jobs are done by main loop,
+ * which drains queue in batches, so interrupt latency does not depend
+ * on log formatting anymore.
+ */
+typedef enum
+{
+    APP_EVT_GPIO,               /* source: pin, value: pin level */
+    APP_EVT_BUTTON,             /* source: button index, value: gesture */
+    APP_EVT_PROBE,              /* source: pin */
+    APP_EVT_PROBE_RATE,         /* source: probe index */
+    APP_EVT_MAIN_LOOP,
+    APP_EVT_SAADC,              /* source: buffer index */
+    APP_EVT_TEMP,               /* source: requests, value: raw temperature */
+    APP_EVT_CAPTURE,            /* source: done or arm timeout */
+    APP_EVT_VDD_ALARM,          /* source: channel, value: limit type */
+} app_evt_type_t;
+
+typedef struct
+{
+    uint8_t type;               /* app_evt_type_t */
+    uint8_t source;
+    uint16_t value;
+} app_evt_t;
+
+NRF_ATFIFO_DEF(app_evt_fifo, app_evt_t, CFG_APP_EVT_QUEUE_SIZE);
+
+/*
+ * Number of events lost because of queue overflow
+ */
+static nrf_atomic_u32_t app_evt_dropped;
+
+static void app_evt_put(app_evt_type_t type, uint8_t source, uint16_t value);
+static void app_evt_notify(void);
+
+#if CFG_ISR_STATS_ENABLED
+/*
+ * Interrupt handler statistics
+ *
+ * Histogram bucket N counts values in range [2^(N-1), 2^N) cycles,
+ * bucket 0 counts zero values and the last one counts all values
+ * above its lower bound.
+ */
+typedef enum
+{
+    ISR_STATS_INPUT,            /* gpio_event_handler or debounce timer */
+    ISR_STATS_RTC0,
+    ISR_STATS_RTC1,
+    ISR_STATS_COUNT
+} isr_stats_id_t;
+
+#define ISR_STATS_BUCKETS 20
+
+typedef struct
+{
+    uint32_t latency[ISR_STATS_BUCKETS];
+    uint32_t duration[ISR_STATS_BUCKETS];
+    uint32_t latency_max;
+    uint32_t duration_max;
+} isr_stats_t;
+
+static const char * const isr_stats_names[ISR_STATS_COUNT] =
+{
+    [ISR_STATS_INPUT] = "input",
+    [ISR_STATS_RTC0] = "rtc0",
+    [ISR_STATS_RTC1] = "rtc1",
+};
+
+static isr_stats_t isr_stats[ISR_STATS_COUNT];
+
+#if CFG_ISR_STATS_LATENCY
+/*
+ * TIMER3 CC Channel [id]: interrupt source event
+ * TIMER3 CC Channel [id + ISR_STATS_COUNT]: handler entry
+ */
+const nrfx_timer_t timer3 = NRFX_TIMER_INSTANCE(3);
+
+STATIC_ASSERT(ISR_STATS_COUNT * 2 <= TIMER3_CC_NUM);
+
+/*
+ * TIMER3 runs at 16 MHz
+ */
+#define ISR_STATS_TIMER_TO_CYCLES(t) ((t) * (SystemCoreClock / 16000000))
+#endif
+
+static inline uint8_t isr_stats_bucket(uint32_t cycles)
+{
+    uint32_t bucket = 32 - __CLZ(cycles);
+
+    return (bucket < ISR_STATS_BUCKETS)? bucket: ISR_STATS_BUCKETS - 1;
 }
 
-void led_blink(uint8_t count)
+static inline uint32_t isr_stats_enter(isr_stats_id_t id)
 {
-    uint32_t current_counter = nrfx_rtc_counter_get(&rtc1);
-    
+    uint32_t start = DWT->CYCCNT;
+
+#if CFG_ISR_STATS_LATENCY
+    nrf_timer_task_trigger(timer3.p_reg,
+            nrf_timer_capture_task_get(id + ISR_STATS_COUNT));
+
+    uint32_t latency = ISR_STATS_TIMER_TO_CYCLES(
+            nrf_timer_cc_read(timer3.p_reg, id + ISR_STATS_COUNT) -
+            nrf_timer_cc_read(timer3.p_reg, id));
+
+    isr_stats[id].latency[isr_stats_bucket(latency)]++;
+    if (latency > isr_stats[id].latency_max)
+    {
+        isr_stats[id].latency_max = latency;
+    }
+#endif
+
+    return start;
+}
+
+static inline void isr_stats_exit(isr_stats_id_t id, uint32_t start)
+{
+    uint32_t duration = DWT->CYCCNT - start;
+
+    isr_stats[id].duration[isr_stats_bucket(duration)]++;
+    if (duration > isr_stats[id].duration_max)
+    {
+        isr_stats[id].duration_max = duration;
+    }
+}
+
+#define ISR_STATS_ENTER(id) uint32_t isr_stats_start = isr_stats_enter(id)
+#define ISR_STATS_EXIT(id) isr_stats_exit(id, isr_stats_start)
+
+static void isr_stats_reset(void)
+{
+    NRFX_CRITICAL_SECTION_ENTER();
+    memset(isr_stats, 0, sizeof(isr_stats));
+    NRFX_CRITICAL_SECTION_EXIT();
+}
+
+static void isr_stats_dump(void)
+{
+    for (uint8_t id = 0; id < ISR_STATS_COUNT; id++)
+    {
+        NRF_LOG_INFO("ISR: %s latency max %u, duration max %u cycles",
+                isr_stats_names[id],
+                isr_stats[id].latency_max,
+                isr_stats[id].duration_max);
+
+        for (uint8_t i = 0; i < ISR_STATS_BUCKETS; i++)
+        {
+            if (isr_stats[id].latency[i] || isr_stats[id].duration[i])
+            {
+                NRF_LOG_INFO("ISR: %s < 2^%d: latency %u, duration %u",
+                        isr_stats_names[id], i,
+                        isr_stats[id].latency[i],
+                        isr_stats[id].duration[i]);
+            }
+        }
+    }
+}
+#else
+#define ISR_STATS_ENTER(id)
+#define ISR_STATS_EXIT(id)
+#endif
+
+/*
+ * Interrupt priority tiers
+ *
+ * All drivers are initialized with sdk_config.h priorities, then
+ * priorities are set from this table, so the plan is kept in one place:
+ * input capture preempts timekeeping, timekeeping preempts DMA buffer
+ * turnaround, telemetry (log, TEMP, clock) preempts nothing. Data shared
+ * between tiers is guarded by critical sections or lock-free queues.
+ */
+typedef enum
+{
+    IRQ_TIER_CAPTURE,
+    IRQ_TIER_TIMEKEEPING,
+    IRQ_TIER_ACQUISITION,
+    IRQ_TIER_TELEMETRY,
+    IRQ_TIER_COUNT
+} irq_tier_t;
+
+typedef struct
+{
+    const char *p_name;
+    uint8_t priority;
+    uint16_t budget_us;         /* Preemption latency budget */
+} irq_tier_config_t;
+
+static const irq_tier_config_t irq_tiers_config[IRQ_TIER_COUNT] =
+{
+    [IRQ_TIER_CAPTURE] = { "capture", 2, 2 },
+    [IRQ_TIER_TIMEKEEPING] = { "timekeeping", 3, 5 },
+    [IRQ_TIER_ACQUISITION] = { "acquisition", 5, 20 },
+    [IRQ_TIER_TELEMETRY] = { "telemetry", 7, 250 },
+};
+
+static const struct
+{
+    IRQn_Type irq;
+    irq_tier_t tier;
+} irq_tiers_map[] =
+{
+    { GPIOTE_IRQn, IRQ_TIER_CAPTURE },
+    { TIMER0_IRQn, IRQ_TIER_CAPTURE },              /* Button debounce */
+    { SWI3_EGU3_IRQn, IRQ_TIER_CAPTURE },           /* Input monitor */
+    { RTC0_IRQn, IRQ_TIER_TIMEKEEPING },
+    { RTC1_IRQn, IRQ_TIER_TIMEKEEPING },
+    { SAADC_IRQn, IRQ_TIER_ACQUISITION },
+    { PWM0_IRQn, IRQ_TIER_ACQUISITION },
+    { RTC2_IRQn, IRQ_TIER_ACQUISITION },
+    { TIMER4_IRQn, IRQ_TIER_ACQUISITION },          /* Capture done */
+    { TEMP_IRQn, IRQ_TIER_TELEMETRY },
+    { POWER_CLOCK_IRQn, IRQ_TIER_TELEMETRY },
+    { TIMER3_IRQn, IRQ_TIER_TELEMETRY },            /* ISR latency */
+    { UARTE0_UART0_IRQn, IRQ_TIER_TELEMETRY },
+};
+
+static uint8_t irq_tier_priority_get(IRQn_Type irq)
+{
+    for (uint8_t i = 0; i < ARRAY_SIZE(irq_tiers_map); i++)
+    {
+        if (irq_tiers_map[i].irq == irq)
+        {
+            return irq_tiers_config[irq_tiers_map[i].tier].priority;
+        }
+    }
+
+    return irq_tiers_config[IRQ_TIER_TELEMETRY].priority;
+}
+
+/*
+ * @brief Function for setting priorities of all mapped interrupts,
+ * called after drivers initialization.
+ */
+static void irq_tiers_apply(void)
+{
+    for (uint8_t i = 0; i < ARRAY_SIZE(irq_tiers_map); i++)
+    {
+        NVIC_SetPriority(irq_tiers_map[i].irq,
+                irq_tiers_config[irq_tiers_map[i].tier].priority);
+    }
+}
+
+static void app_evt_put(app_evt_type_t type, uint8_t source, uint16_t value)
+{
+    app_evt_t evt =
+    {
+        .type = type,
+        .source = source,
+        .value = value,
+    };
+
+    if (nrf_atfifo_alloc_put(app_evt_fifo, &evt, sizeof(evt), NULL) !=
+            NRF_SUCCESS)
+    {
+        nrf_atomic_u32_add(&app_evt_dropped, 1);
+    }
+
+    app_evt_notify();
+}
+
+
+/*
+ * Virtual timers
+ *
+ * Any number of one-shot and periodic timers share RTC1 CC Channel 0.
+ * Running timers are kept in binary min-heap ordered by deadline, so
+ * start and stop are O(log n), and only the nearest deadline is
+ * programmed into compare register. Deadlines are 64 bit timebase
+ * ticks, so they never wrap, deadlines farther than half of counter range
+ * are reached in several compare steps.
+ *
+ * Timer handlers are called from RTC1 interrupt.
+ */
+typedef void (*vtimer_handler_t)(void *p_context);
+
+typedef struct
+{
+    timebase_t deadline;
+    uint32_t period;            /* 0 for one-shot timer */
+    vtimer_handler_t handler;
+    void *p_context;
+    uint16_t heap_index;        /* VTIMER_INDEX_NONE if not running */
+} vtimer_t;
+
+#define VTIMER_INDEX_NONE 0xFFFF
+
+STATIC_ASSERT(CFG_VTIMER_MAX < VTIMER_INDEX_NONE);
+
+#define VTIMER_INIT(_handler, _p_context) \
+    { .handler = (_handler), .p_context = (_p_context), \
+      .heap_index = VTIMER_INDEX_NONE }
+
+static vtimer_t *vtimer_heap[CFG_VTIMER_MAX];
+static uint16_t vtimer_count;
+
+static inline bool vtimer_before(vtimer_t const *p_a, vtimer_t const *p_b)
+{
+    return p_a->deadline < p_b->deadline;
+}
+
+static inline void vtimer_heap_set(uint16_t index, vtimer_t *p_timer)
+{
+    vtimer_heap[index] = p_timer;
+    p_timer->heap_index = index;
+}
+
+static void vtimer_sift_up(uint16_t index)
+{
+    vtimer_t *p_timer = vtimer_heap[index];
+
+    while (index > 0)
+    {
+        uint16_t parent = (index - 1) / 2;
+
+        if (!vtimer_before(p_timer, vtimer_heap[parent]))
+        {
+            break;
+        }
+
+        vtimer_heap_set(index, vtimer_heap[parent]);
+        index = parent;
+    }
+
+    vtimer_heap_set(index, p_timer);
+}
+
+static void vtimer_sift_down(uint16_t index)
+{
+    vtimer_t *p_timer = vtimer_heap[index];
+
+    while (true)
+    {
+        uint16_t child = index * 2 + 1;
+
+        if (child >= vtimer_count)
+        {
+            break;
+        }
+
+        if ((child + 1 < vtimer_count) &&
+                vtimer_before(vtimer_heap[child + 1], vtimer_heap[child]))
+        {
+            child++;
+        }
+
+        if (!vtimer_before(vtimer_heap[child], p_timer))
+        {
+            break;
+        }
+
+        vtimer_heap_set(index, vtimer_heap[child]);
+        index = child;
+    }
+
+    vtimer_heap_set(index, p_timer);
+}
+
+static void vtimer_heap_remove(vtimer_t *p_timer)
+{
+    uint16_t index = p_timer->heap_index;
+    vtimer_t *p_last = vtimer_heap[--vtimer_count];
+
+    p_timer->heap_index = VTIMER_INDEX_NONE;
+
+    if (p_last == p_timer)
+    {
+        return;
+    }
+
+    vtimer_heap_set(index, p_last);
+
+    if ((index > 0) && vtimer_before(p_last, vtimer_heap[(index - 1) / 2]))
+    {
+        vtimer_sift_up(index);
+    }
+    else
+    {
+        vtimer_sift_down(index);
+    }
+}
+
+static void vtimer_heap_insert(vtimer_t *p_timer)
+{
+    APP_ERROR_CHECK_BOOL(vtimer_count < CFG_VTIMER_MAX);
+
+    vtimer_heap_set(vtimer_count++, p_timer);
+    vtimer_sift_up(p_timer->heap_index);
+}
+
+/*
+ * Program RTC1 CC Channel 0 with the nearest deadline
+ */
+static void vtimer_cc_update(void)
+{
+    timebase_t now;
+    uint64_t delta;
+    uint32_t cc;
+    uint32_t counter;
+
+    if (vtimer_count == 0)
+    {
+        nrfx_rtc_cc_disable(&rtc1, 0);
+        return;
+    }
+
+    now = timebase_now();
+    delta = (vtimer_heap[0]->deadline > now)?
+            vtimer_heap[0]->deadline - now: 0;
+
+    if (delta < RTC_CC_MIN_DELTA)
+    {
+        /*
+         * Deadline is too close or already passed
+         */
+        delta = RTC_CC_MIN_DELTA;
+    }
+    else if (delta >= RTC_COUNTER_HALF_RANGE)
+    {
+        /*
+         * Deadline is out of counter range, intermediate compare
+         */
+        delta = RTC_COUNTER_HALF_RANGE - 1;
+    }
+
+    cc = (uint32_t)(now + delta) & RTC_COUNTER_MASK;
+
+    while (true)
+    {
+        nrfx_rtc_cc_set(&rtc1, 0, cc, true);
+
+        counter = nrfx_rtc_counter_get(&rtc1);
+        if (!RTC_CC_TOO_CLOSE(cc, counter))
+        {
+            break;
+        }
+
+        /*
+         * Counter has reached compare value while it was set, so event may
+         * be lost: move it forward, spurious COMPARE0 is harmless
+         */
+        cc = (counter + RTC_CC_MIN_DELTA) & RTC_COUNTER_MASK;
+    }
+}
+
+/*
+ * @brief Function for starting virtual timer.
+ *
+ * Running timer is restarted.
+ *
+ * @param delay     Ticks until first expiration.
+ * @param period    Ticks between expirations, 0 for one-shot timer.
+ */
+static void vtimer_start(vtimer_t *p_timer, uint32_t delay, uint32_t period)
+{
+    NRFX_CRITICAL_SECTION_ENTER();
+
+    if (p_timer->heap_index != VTIMER_INDEX_NONE)
+    {
+        vtimer_heap_remove(p_timer);
+    }
+
+    p_timer->deadline = timebase_now() + delay;
+    p_timer->period = period;
+
+    vtimer_heap_insert(p_timer);
+
+    if (p_timer->heap_index == 0)
+    {
+        vtimer_cc_update();
+    }
+
+    NRFX_CRITICAL_SECTION_EXIT();
+}
+
+static void vtimer_stop(vtimer_t *p_timer)
+{
+    NRFX_CRITICAL_SECTION_ENTER();
+
+    if (p_timer->heap_index != VTIMER_INDEX_NONE)
+    {
+        /*
+         * Compare channel is left armed if other timer is the nearest,
+         * spurious COMPARE0 is harmless
+         */
+        vtimer_heap_remove(p_timer);
+
+        if (vtimer_count == 0)
+        {
+            vtimer_cc_update();
+        }
+    }
+
+    NRFX_CRITICAL_SECTION_EXIT();
+}
+
+static inline bool vtimer_is_running(vtimer_t const *p_timer)
+{
+    return p_timer->heap_index != VTIMER_INDEX_NONE;
+}
+
+/*
+ * RTC1 CC Channel 0 handler: call handlers of all expired timers
+ * and reschedule periodic ones
+ */
+static void vtimer_process(void)
+{
+    while (true)
+    {
+        vtimer_t *p_timer = NULL;
+
+        NRFX_CRITICAL_SECTION_ENTER();
+
+        if ((vtimer_count > 0) &&
+                (vtimer_heap[0]->deadline <= timebase_now()))
+        {
+            p_timer = vtimer_heap[0];
+            vtimer_heap_remove(p_timer);
+
+            if (p_timer->period)
+            {
+                /*
+                 * Next deadline is counted from previous one,
+                 * so periodic timer does not drift
+                 */
+                p_timer->deadline += p_timer->period;
+                vtimer_heap_insert(p_timer);
+            }
+        }
+        else
+        {
+            vtimer_cc_update();
+        }
+
+        NRFX_CRITICAL_SECTION_EXIT();
+
+        if (p_timer == NULL)
+        {
+            break;
+        }
+
+        p_timer->handler(p_timer->p_context);
+    }
+}
+
+/*
+ * Run-to-completion scheduler
+ *
+ * Tasks are posted by interrupt handlers or by other tasks to FIFO run
+ * queue of own priority and run by main loop to completion, highest
+ * priority first. Task may be posted by its own virtual timer after delay
+ * or periodically, so pending timers are ordered by deadline in virtual
+ * timer heap and RTC1 CC Channel 0 holds the nearest one: there is no
+ * tick, main loop sleeps until the next interrupt when run queues and log
+ * are empty.
+ *
+ * Every task collects run count, run time in DWT cycles and number of
+ * runs started later than its deadline after post.
+ */
+typedef enum
+{
+    SCHED_PRIO_HIGH,
+    SCHED_PRIO_NORMAL,
+    SCHED_PRIO_LOW,
+    SCHED_PRIO_COUNT
+} sched_prio_t;
+
+typedef struct sched_task_s
+{
+    void (*handler)(void);
+    const char *p_name;
+    uint8_t prio;
+    bool queued;
+    bool registered;
+    uint32_t deadline;          /* Ticks from post to run, 0: none */
+    timebase_t posted;
+    struct sched_task_s *p_next;
+    vtimer_t timer;
+    uint32_t runs;
+    uint32_t missed;
+    uint64_t cycles_total;
+    uint32_t cycles_max;
+} sched_task_t;
+
+static void sched_timer_handler(void *p_context);
+
+#define SCHED_TASK_DEF(name, task_handler, task_prio, deadline_ms) \
+    static sched_task_t name = \
+    { \
+        .handler = task_handler, \
+        .p_name = #name, \
+        .prio = task_prio, \
+        .deadline = TIMEBASE_MS_TO_TICKS(deadline_ms), \
+        .timer = VTIMER_INIT(sched_timer_handler, &name) \
+    }
+
+static struct
+{
+    sched_task_t *p_head;
+    sched_task_t *p_tail;
+} sched_queues[SCHED_PRIO_COUNT];
+
+/*
+ * Bit per non-empty run queue
+ */
+static volatile uint32_t sched_ready;
+
+/*
+ * Tasks posted at least once, for statistics
+ */
+static sched_task_t *sched_tasks[CFG_SCHED_TASK_MAX];
+static uint8_t sched_task_count;
+
+/*
+ * @brief Function for posting task, may be called from interrupt handler.
+ *
+ * Task which is already queued is not queued again.
+ */
+static void sched_post(sched_task_t *p_task)
+{
+    NRFX_CRITICAL_SECTION_ENTER();
+
+    if (!p_task->queued)
+    {
+        p_task->queued = true;
+        p_task->posted = timebase_now();
+        p_task->p_next = NULL;
+
+        if (sched_queues[p_task->prio].p_tail)
+        {
+            sched_queues[p_task->prio].p_tail->p_next = p_task;
+        }
+        else
+        {
+            sched_queues[p_task->prio].p_head = p_task;
+        }
+        sched_queues[p_task->prio].p_tail = p_task;
+        sched_ready |= 1u << p_task->prio;
+
+        if (!p_task->registered && sched_task_count < CFG_SCHED_TASK_MAX)
+        {
+            p_task->registered = true;
+            sched_tasks[sched_task_count++] = p_task;
+        }
+    }
+
+    NRFX_CRITICAL_SECTION_EXIT();
+}
+
+static void sched_timer_handler(void *p_context)
+{
+    sched_post((sched_task_t *)p_context);
+}
+
+/*
+ * @brief Function for posting task after delay and then every period (if
+ * not 0), in timebase ticks.
+ */
+static void sched_post_delayed(sched_task_t *p_task, uint32_t delay,
+        uint32_t period)
+{
+    vtimer_start(&p_task->timer, delay, period);
+}
+
+static sched_task_t *sched_pop(void)
+{
+    sched_task_t *p_task = NULL;
+
+    NRFX_CRITICAL_SECTION_ENTER();
+
+    if (sched_ready)
+    {
+        uint8_t prio = __CLZ(__RBIT(sched_ready));
+
+        p_task = sched_queues[prio].p_head;
+        sched_queues[prio].p_head = p_task->p_next;
+        if (sched_queues[prio].p_head == NULL)
+        {
+            sched_queues[prio].p_tail = NULL;
+            sched_ready &= ~(1u << prio);
+        }
+
+        /*
+         * Task may be posted again while it runs
+         */
+        p_task->queued = false;
+    }
+
+    NRFX_CRITICAL_SECTION_EXIT();
+
+    return p_task;
+}
+
+static void sched_task_run(sched_task_t *p_task)
+{
+    uint64_t latency = timebase_now() - p_task->posted;
+    uint32_t start = DWT->CYCCNT;
+    uint32_t cycles;
+
+    p_task->handler();
+
+    cycles = DWT->CYCCNT - start;
+    p_task->runs++;
+    p_task->cycles_total += cycles;
+    if (cycles > p_task->cycles_max)
+    {
+        p_task->cycles_max = cycles;
+    }
+    if (p_task->deadline && latency > p_task->deadline)
+    {
+        p_task->missed++;
+    }
+}
+
+static void sched_stats_dump(void)
+{
+    for (uint8_t i = 0; i < sched_task_count; i++)
+    {
+        sched_task_t const *p_task = sched_tasks[i];
+
+        NRF_LOG_INFO("SCHED: %s runs %u missed %u cycles avg %u max %u",
+                p_task->p_name, p_task->runs, p_task->missed,
+                (uint32_t)(p_task->cycles_total / MAX(p_task->runs, 1)),
+                p_task->cycles_max);
+    }
+}
+
+static void sched_init(void)
+{
+    /*
+     * DWT cycle counter for task run time
+     */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/*
+ * @brief Function for running tasks, never returns.
+ */
+static void sched_run(void)
+{
+    while (true)
+    {
+        sched_task_t *p_task = sched_pop();
+
+        if (p_task)
+        {
+            sched_task_run(p_task);
+            continue;
+        }
+
+        /*
+         * Log is processed when there are no tasks
+         */
+        if (NRF_LOG_PROCESS())
+        {
+            continue;
+        }
+        NRF_LOG_FLUSH();
+
+        /*
+         * With interrupts masked post can not be lost between the check
+         * and WFI: pending interrupt wakes the CPU and is taken after
+         * unmasking
+         */
+        __disable_irq();
+        if (!sched_ready)
+        {
+            __WFI();
+        }
+        __enable_irq();
+    }
+}
+
+/*
+ * Application jobs
+ *
+ * Job is a protothread run by own scheduler task: it is written as
+ * sequential code but returns to scheduler on every wait and keeps only
+ * continuation and a few wait fields in RAM instead of own stack. Local
+ * variables do not survive waits, so job keeps its state in static ones.
+ *
+ * Job task is posted when something job waits for is signaled: its
+ * virtual timer expires, awaited application event is processed or
+ * EasyDMA transfer is done, then wait condition is checked again.
+ */
+typedef struct job_s
+{
+    struct pt pt;
+    PT_THREAD((*thread)(struct job_s *p_job));
+    sched_task_t *p_task;
+    bool running;
+    bool registered;
+    timebase_t deadline;        /* JOB_WAIT_MS */
+    uint8_t evt_wait;           /* JOB_WAIT_EVT, app_evt_type_t */
+    bool evt_received;
+    app_evt_t evt;              /* Last awaited event */
+} job_t;
+
+/*
+ * EasyDMA transfer completion, busy is set when transfer is started and
+ * cleared by peripheral interrupt handler
+ */
+typedef struct
+{
+    volatile bool busy;
+    job_t * volatile p_job;
+} job_dma_t;
+
+#define JOB_EVT_NONE 0xFF
+
+static void job_run(job_t *p_job);
+
+#define JOB_DEF(name, job_thread) \
+    static job_t name; \
+    static void name##_run(void) { job_run(&name); } \
+    SCHED_TASK_DEF(name##_task, name##_run, SCHED_PRIO_NORMAL, 0); \
+    static job_t name = { .thread = job_thread, .p_task = &name##_task }
+
+#define JOB_WAIT_MS(p_job, ms) \
+    do \
+    { \
+        (p_job)->deadline = timebase_now() + TIMEBASE_MS_TO_TICKS(ms); \
+        sched_post_delayed((p_job)->p_task, TIMEBASE_MS_TO_TICKS(ms), 0); \
+        PT_WAIT_UNTIL(&(p_job)->pt, timebase_now() >= (p_job)->deadline); \
+    } while (0)
+
+#define JOB_WAIT_EVT(p_job, evt_type) \
+    do \
+    { \
+        (p_job)->evt_wait = (evt_type); \
+        (p_job)->evt_received = false; \
+        PT_WAIT_UNTIL(&(p_job)->pt, (p_job)->evt_received); \
+    } while (0)
+
+#define JOB_WAIT_DMA(p_job, p_dma) \
+    do \
+    { \
+        (p_dma)->p_job = (p_job); \
+        PT_WAIT_WHILE(&(p_job)->pt, (p_dma)->busy); \
+        (p_dma)->p_job = NULL; \
+    } while (0)
+
+static job_t *jobs[CFG_JOB_MAX];
+static uint8_t job_count;
+
+static void job_run(job_t *p_job)
+{
+    char state;
+
+    if (!p_job->running)
+    {
+        return;
+    }
+
+    state = p_job->thread(p_job);
+    if (state == PT_YIELDED)
+    {
+        sched_post(p_job->p_task);
+    }
+    else if (state >= PT_EXITED)
+    {
+        p_job->running = false;
+        vtimer_stop(&p_job->p_task->timer);
+    }
+}
+
+/*
+ * @brief Function for starting job from the beginning, called from main
+ * loop.
+ *
+ * @return false if job is still running.
+ */
+static bool job_start(job_t *p_job)
+{
+    if (p_job->running)
+    {
+        return false;
+    }
+
+    if (!p_job->registered)
+    {
+        APP_ERROR_CHECK_BOOL(job_count < CFG_JOB_MAX);
+        p_job->registered = true;
+        jobs[job_count++] = p_job;
+    }
+
+    PT_INIT(&p_job->pt);
+    p_job->evt_wait = JOB_EVT_NONE;
+    p_job->running = true;
+    sched_post(p_job->p_task);
+
+    return true;
+}
+
+/*
+ * @brief Function for passing application event to jobs waiting for it,
+ * called from main loop after the event is processed.
+ */
+static void job_evt_signal(app_evt_t const *p_evt)
+{
+    for (uint8_t i = 0; i < job_count; i++)
+    {
+        job_t *p_job = jobs[i];
+
+        if (p_job->running && p_job->evt_wait == p_evt->type)
+        {
+            p_job->evt = *p_evt;
+            p_job->evt_received = true;
+            p_job->evt_wait = JOB_EVT_NONE;
+            sched_post(p_job->p_task);
+        }
+    }
+}
+
+static inline void job_dma_start(job_dma_t *p_dma)
+{
+    p_dma->busy = true;
+}
+
+/*
+ * @brief Function for signaling transfer completion, called from
+ * interrupt handler.
+ */
+static void job_dma_done(job_dma_t *p_dma)
+{
+    job_t *p_job = p_dma->p_job;
+
+    p_dma->busy = false;
+    if (p_job)
+    {
+        sched_post(p_job->p_task);
+    }
+}
+
+#if CFG_IRQ_SELFTEST_ENABLED
+/*
+ * Interrupt priority tiers self-test
+ *
+ * Load handler (EGU4) runs at telemetry priority and holds a private
+ * critical section of CFG_IRQ_SELFTEST_CS_CYCLES every other
+ * CFG_IRQ_SELFTEST_CS_CYCLES, as the application ones do, without
+ * touching timer heap or run queues. It triggers probe handler (EGU5) at
+ * an offset shifted by IRQ_SELFTEST_OFFSET_STEP cycles every run, so
+ * trigger lands inside and outside of the critical section. Probe runs at
+ * priority of every tier in turn and the worst latency from trigger to
+ * probe entry is checked against the tier budget. Test runs from a job
+ * with all drivers active, so their handlers add to the latency as well.
+ *
+ * NVMC page erase of the flash log halts CPU with all interrupts, it is
+ * not measured but reported with its maximum duration.
+ */
+#define IRQ_SELFTEST_OFFSET_STEP 17
+#define IRQ_SELFTEST_RUN_MS 1       /* Wait for one run */
+#define IRQ_NVMC_ERASE_MAX_MS 90    /* tERASEPAGE maximum */
+
+STATIC_ASSERT(CFG_IRQ_SELFTEST_LOAD_US < IRQ_SELFTEST_RUN_MS * 1000);
+
+static volatile uint32_t irq_selftest_offset;
+static volatile uint32_t irq_selftest_trigger;
+static volatile uint32_t irq_selftest_latency;
+static volatile bool irq_selftest_triggered;
+static volatile bool irq_selftest_done;
+
+static struct
+{
+    uint8_t tier;
+    uint8_t run;                /* Runs started in the tier */
+    uint8_t failed;
+    uint32_t latency_max;
+} irq_selftest;
+
+/*
+ * Busy loop of the load, triggers probe at the run offset
+ */
+static void irq_selftest_busy(uint32_t start, uint32_t cycles)
+{
+    uint32_t begin = DWT->CYCCNT;
+
+    while (DWT->CYCCNT - begin < cycles)
+    {
+        if (!irq_selftest_triggered &&
+                (DWT->CYCCNT - start >= irq_selftest_offset))
+        {
+            irq_selftest_triggered = true;
+            irq_selftest_trigger = DWT->CYCCNT;
+            nrf_egu_task_trigger(NRF_EGU5, NRF_EGU_TASK_TRIGGER0);
+        }
+    }
+}
+
+void SWI4_EGU4_IRQHandler(void)
+{
+    uint32_t start = DWT->CYCCNT;
+    uint32_t load = CFG_IRQ_SELFTEST_LOAD_US * (SystemCoreClock / 1000000);
+
+    nrf_egu_event_clear(NRF_EGU4, NRF_EGU_EVENT_TRIGGERED0);
+
+    while (DWT->CYCCNT - start < load)
+    {
+        NRFX_CRITICAL_SECTION_ENTER();
+        irq_selftest_busy(start, CFG_IRQ_SELFTEST_CS_CYCLES);
+        NRFX_CRITICAL_SECTION_EXIT();
+
+        irq_selftest_busy(start, CFG_IRQ_SELFTEST_CS_CYCLES);
+    }
+}
+
+void SWI5_EGU5_IRQHandler(void)
+{
+    uint32_t entry = DWT->CYCCNT;
+
+    nrf_egu_event_clear(NRF_EGU5, NRF_EGU_EVENT_TRIGGERED0);
+
+    irq_selftest_latency = entry - irq_selftest_trigger;
+    irq_selftest_done = true;
+}
+
+static void irq_selftest_begin(void)
+{
+    memset(&irq_selftest, 0, sizeof(irq_selftest));
+
+    nrf_egu_event_clear(NRF_EGU4, NRF_EGU_EVENT_TRIGGERED0);
+    nrf_egu_event_clear(NRF_EGU5, NRF_EGU_EVENT_TRIGGERED0);
+    nrf_egu_int_enable(NRF_EGU4, NRF_EGU_INT_TRIGGERED0);
+    nrf_egu_int_enable(NRF_EGU5, NRF_EGU_INT_TRIGGERED0);
+    NVIC_SetPriority(SWI4_EGU4_IRQn,
+            irq_tiers_config[IRQ_TIER_TELEMETRY].priority);
+    NVIC_EnableIRQ(SWI4_EGU4_IRQn);
+    NVIC_EnableIRQ(SWI5_EGU5_IRQn);
+}
+
+static void irq_selftest_tier_check(void)
+{
+    irq_tier_config_t const *p_config = &irq_tiers_config[irq_selftest.tier];
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    uint32_t latency_us = (irq_selftest.latency_max + cycles_per_us - 1) /
+            cycles_per_us;
+
+    if (latency_us > p_config->budget_us)
+    {
+        NRF_LOG_WARNING("IRQ: tier %s priority %d latency %u us, "
+                "budget %u us", p_config->p_name, p_config->priority,
+                latency_us, p_config->budget_us);
+        irq_selftest.failed++;
+    }
+    else
+    {
+        NRF_LOG_INFO("IRQ: tier %s priority %d latency %u cycles",
+                p_config->p_name, p_config->priority,
+                irq_selftest.latency_max);
+    }
+}
+
+/*
+ * @brief Function for collecting result of the last run and starting the
+ * next one, called from job every IRQ_SELFTEST_RUN_MS.
+ *
+ * @return false when all tiers are tested.
+ */
+static bool irq_selftest_step(void)
+{
+    if (irq_selftest.run > 0)
+    {
+        if (!irq_selftest_done)
+        {
+            return true;
+        }
+
+        irq_selftest.latency_max = MAX(irq_selftest.latency_max,
+                irq_selftest_latency);
+
+        if (irq_selftest.run == CFG_IRQ_SELFTEST_RUNS)
+        {
+            irq_selftest_tier_check();
+            irq_selftest.tier++;
+            irq_selftest.run = 0;
+            irq_selftest.latency_max = 0;
+        }
+    }
+
+    if (irq_selftest.tier == IRQ_TIER_COUNT)
+    {
+        return false;
+    }
+
+    if (irq_selftest.run == 0)
+    {
+        NVIC_SetPriority(SWI5_EGU5_IRQn,
+                irq_tiers_config[irq_selftest.tier].priority);
+    }
+
+    irq_selftest_offset = irq_selftest.run * IRQ_SELFTEST_OFFSET_STEP;
+    irq_selftest_triggered = false;
+    irq_selftest_done = false;
+    irq_selftest.run++;
+    nrf_egu_task_trigger(NRF_EGU4, NRF_EGU_TASK_TRIGGER0);
+
+    return true;
+}
+
+/*
+ * @return Number of tiers over budget.
+ */
+static uint8_t irq_selftest_end(void)
+{
+    NVIC_DisableIRQ(SWI4_EGU4_IRQn);
+    NVIC_DisableIRQ(SWI5_EGU5_IRQn);
+    nrf_egu_int_disable(NRF_EGU4, NRF_EGU_INT_TRIGGERED0);
+    nrf_egu_int_disable(NRF_EGU5, NRF_EGU_INT_TRIGGERED0);
+
+#if CFG_FLOG_ENABLED
+    NRF_LOG_WARNING("IRQ: flash log page erase stalls all tiers up to %d ms",
+            IRQ_NVMC_ERASE_MAX_MS);
+#endif
+
+    return irq_selftest.failed;
+}
+#endif
+
+#if CFG_STATS_ENABLED
+/*
+ * Streaming statistics
+ *
+ * Every sample updates running min/max/mean/variance (Welford) since
+ * start, EWMA and the open 1 min window only. Minute window is closed by
+ * periodic virtual timer and merged into hour window, hour into day one,
+ * so the cost per sample is O(1) and RAM is fixed.
+ */
+typedef enum
+{
+    STATS_VDD,                  /* mV */
+    STATS_TEMP,                 /* C */
+    STATS_COUNT
+} stats_id_t;
+
+typedef enum
+{
+    STATS_WINDOW_MINUTE,
+    STATS_WINDOW_HOUR,
+    STATS_WINDOW_DAY,
+    STATS_WINDOW_COUNT
+} stats_window_t;
+
+typedef struct
+{
+    uint32_t count;
+    float mean;
+    float m2;                   /* sum of squared differences from mean */
+    float min;
+    float max;
+} stats_acc_t;
+
+typedef struct
+{
+    stats_acc_t total;
+    float ewma;
+    stats_acc_t window[STATS_WINDOW_COUNT];     /* open windows */
+    stats_acc_t last[STATS_WINDOW_COUNT];       /* last closed windows */
+} stats_t;
+
+static const char * const stats_names[STATS_COUNT] =
+{
+    [STATS_VDD] = "vdd",
+    [STATS_TEMP] = "temp",
+};
+
+static const char * const stats_window_names[STATS_WINDOW_COUNT] =
+{
+    [STATS_WINDOW_MINUTE] = "1min",
+    [STATS_WINDOW_HOUR] = "1h",
+    [STATS_WINDOW_DAY] = "1day",
+};
+
+/*
+ * Window lengths in minutes
+ */
+static const uint16_t stats_window_minutes[STATS_WINDOW_COUNT] =
+{
+    [STATS_WINDOW_MINUTE] = 1,
+    [STATS_WINDOW_HOUR] = 60,
+    [STATS_WINDOW_DAY] = 1440,
+};
+
+static stats_t stats[STATS_COUNT];
+static uint32_t stats_minutes;
+
+static void stats_acc_add(stats_acc_t *p_acc, float value)
+{
+    float delta = value - p_acc->mean;
+
+    if (p_acc->count++ == 0)
+    {
+        p_acc->min = value;
+        p_acc->max = value;
+    }
+    else
+    {
+        p_acc->min = fminf(p_acc->min, value);
+        p_acc->max = fmaxf(p_acc->max, value);
+    }
+
+    p_acc->mean += delta / p_acc->count;
+    p_acc->m2 += delta * (value - p_acc->mean);
+}
+
+/*
+ * Parallel variant of Welford algorithm: merges p_src into p_dst
+ */
+static void stats_acc_merge(stats_acc_t *p_dst, stats_acc_t const *p_src)
+{
+    if (p_src->count == 0)
+    {
+        return;
+    }
+    if (p_dst->count == 0)
+    {
+        *p_dst = *p_src;
+        return;
+    }
+
+    uint32_t count = p_dst->count + p_src->count;
+    float delta = p_src->mean - p_dst->mean;
+
+    p_dst->mean += delta * p_src->count / count;
+    p_dst->m2 += p_src->m2 +
+            delta * delta * p_dst->count * p_src->count / count;
+    p_dst->min = fminf(p_dst->min, p_src->min);
+    p_dst->max = fmaxf(p_dst->max, p_src->max);
+    p_dst->count = count;
+}
+
+static float stats_acc_sd(stats_acc_t const *p_acc)
+{
+    return (p_acc->count > 1)? sqrtf(p_acc->m2 / (p_acc->count - 1)): 0;
+}
+
+/*
+ * @brief Function for adding sample, called from main loop.
+ */
+static void stats_add(stats_id_t id, float value)
+{
+    stats_t *p_stats = &stats[id];
+
+    p_stats->ewma = (p_stats->total.count == 0)? value:
+            p_stats->ewma + CFG_STATS_EWMA_ALPHA * (value - p_stats->ewma);
+    stats_acc_add(&p_stats->total, value);
+    stats_acc_add(&p_stats->window[STATS_WINDOW_MINUTE], value);
+}
+
+static void stats_report(stats_id_t id, stats_window_t window)
+{
+    stats_t const *p_stats = &stats[id];
+    stats_acc_t const *p_acc = &p_stats->last[window];
+
+    NRF_LOG_INFO("STATS: %s %s n %u mean " NRF_LOG_FLOAT_MARKER,
+            stats_names[id], stats_window_names[window], p_acc->count,
+            NRF_LOG_FLOAT(p_acc->mean));
+    NRF_LOG_INFO("STATS: %s %s min " NRF_LOG_FLOAT_MARKER
+            " max " NRF_LOG_FLOAT_MARKER,
+            stats_names[id], stats_window_names[window],
+            NRF_LOG_FLOAT(p_acc->min), NRF_LOG_FLOAT(p_acc->max));
+    NRF_LOG_INFO("STATS: %s %s sd " NRF_LOG_FLOAT_MARKER
+            " ewma " NRF_LOG_FLOAT_MARKER,
+            stats_names[id], stats_window_names[window],
+            NRF_LOG_FLOAT(stats_acc_sd(p_acc)),
+            NRF_LOG_FLOAT(p_stats->ewma));
+}
+
+/*
+ * @brief Function for closing windows, called from main loop every
+ * minute.
+ */
+static void stats_window_close(void)
+{
+    stats_minutes++;
+
+    for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++)
+    {
+        if (stats_minutes % stats_window_minutes[w])
+        {
+            break;
+        }
+
+        for (uint8_t id = 0; id < STATS_COUNT; id++)
+        {
+            stats_t *p_stats = &stats[id];
+
+            if (w + 1 < STATS_WINDOW_COUNT)
+            {
+                stats_acc_merge(&p_stats->window[w + 1],
+                        &p_stats->window[w]);
+            }
+            p_stats->last[w] = p_stats->window[w];
+            memset(&p_stats->window[w], 0, sizeof(p_stats->window[w]));
+
+            stats_report(id, w);
+        }
+    }
+}
+
+SCHED_TASK_DEF(stats_task, stats_window_close, SCHED_PRIO_LOW, 1000);
+
+#define STATS_MINUTE TIMEBASE_MS_TO_TICKS(60000)
+
+static void stats_init(void)
+{
+    sched_post_delayed(&stats_task, STATS_MINUTE, STATS_MINUTE);
+}
+#endif
+
+#if CFG_TSERIES_ENABLED
+/*
+ * Compressed time series of (time, VDD, temperature) records
+ *
+ * Ring of fixed size blocks, the oldest block is overwritten when the
+ * ring is full. First record of a block is stored in block header, next
+ * ones as deltas from previous record: delta-of-delta for time, delta
+ * for values, all zigzag encoded. Record starts with control byte:
+ *
+ *   bits 7..6: 0 - record, 1 - run of (bits 5..0 + 1) records with all
+ *              deltas zero (periodic samples of unchanged values)
+ *   bits 1..0, 3..2, 5..4: time, VDD, temperature field size class:
+ *              0 - value is 0, no bytes, 1 - 1 byte, 2 - 2 bytes, 3 - 4
+ *              bytes, little endian
+ *
+ * Time is timebase in ms, truncated to 32 bits. Records are timestamped
+ * with scheduled time of RTC0 tick which started the measurement, not
+ * with the time of processing, so periodic records have delta-of-delta 0
+ * and go to runs.
+ *
+ * Every block gets a sequence number, so export running across main loop
+ * passes detects blocks overwritten by appends since its start.
+ */
+#define TSERIES_BLOCK_SIZE 128
+#define TSERIES_RECORD_MAX (1 + 4 + 4 + 4)
+
+#define TSERIES_CTRL_RUN 0x40
+#define TSERIES_CTRL_RUN_MAX 0x3F
+#define TSERIES_RUN_NONE 0xFFFF
+
+#define TSERIES_DUMP_PAUSE_MS 10
+
+typedef struct
+{
+    uint32_t t0;
+    int32_t temp0;
+    int16_t vdd0;
+    uint16_t used;              /* data bytes */
+    uint16_t count;             /* records including the first one */
+    uint16_t seq;               /* block sequence number */
+} tseries_block_hdr_t;
+
+#define TSERIES_DATA_SIZE (TSERIES_BLOCK_SIZE - sizeof(tseries_block_hdr_t))
+
+typedef struct
+{
+    tseries_block_hdr_t hdr;
+    uint8_t data[TSERIES_DATA_SIZE];
+} tseries_block_t;
+
+STATIC_ASSERT(sizeof(tseries_block_t) == TSERIES_BLOCK_SIZE);
+
+static tseries_block_t tseries_blocks[CFG_TSERIES_BLOCK_COUNT];
+static uint16_t tseries_head;
+static uint16_t tseries_blocks_used;
+static uint16_t tseries_seq;    /* sequence number of the next block */
+
+/*
+ * Encoder state: last record and run byte offset in head block
+ */
+static struct
+{
+    uint32_t t;
+    int32_t dt;
+    int16_t vdd;
+    int32_t temp;
+    uint16_t run;
+} tseries_enc;
+
+static uint8_t tseries_field_put(uint8_t *p_dst, int32_t value,
+        uint8_t *p_code)
+{
+    uint32_t zz = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    uint8_t size;
+
+    if (zz == 0)
+    {
+        *p_code = 0;
+        size = 0;
+    }
+    else if (zz <= UINT8_MAX)
+    {
+        *p_code = 1;
+        size = 1;
+    }
+    else if (zz <= UINT16_MAX)
+    {
+        *p_code = 2;
+        size = 2;
+    }
+    else
+    {
+        *p_code = 3;
+        size = 4;
+    }
+
+    for (uint8_t i = 0; i < size; i++)
+    {
+        p_dst[i] = (uint8_t)(zz >> (8 * i));
+    }
+
+    return size;
+}
+
+static int32_t tseries_field_get(uint8_t const *p_src, uint8_t code,
+        uint8_t *p_size)
+{
+    static const uint8_t sizes[] = { 0, 1, 2, 4 };
+    uint32_t zz = 0;
+
+    *p_size = sizes[code];
+    for (uint8_t i = 0; i < *p_size; i++)
+    {
+        zz |= (uint32_t)p_src[i] << (8 * i);
+    }
+
+    return (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+}
+
+/*
+ * @brief Function for appending record, O(1), called from main loop.
+ */
+static void tseries_append(timebase_t now, int16_t vdd, int32_t temp)
+{
+    uint32_t t = (uint32_t)TIMEBASE_TICKS_TO_MS(now);
+    tseries_block_t *p_block = &tseries_blocks[tseries_head];
+    uint8_t record[TSERIES_RECORD_MAX];
+    uint8_t size = 0;
+    int32_t dt = 0;
+
+    if (tseries_blocks_used)
+    {
+        dt = t - tseries_enc.t;
+
+        int32_t dod = dt - tseries_enc.dt;
+        int32_t dvdd = vdd - tseries_enc.vdd;
+        int32_t dtemp = temp - tseries_enc.temp;
+
+        if (dod == 0 && dvdd == 0 && dtemp == 0)
+        {
+            uint16_t run = tseries_enc.run;
+
+            if (run != TSERIES_RUN_NONE &&
+                    (p_block->data[run] & TSERIES_CTRL_RUN_MAX) <
+                    TSERIES_CTRL_RUN_MAX)
+            {
+                p_block->data[run]++;
+                p_block->hdr.count++;
+                tseries_enc.t = t;
+                return;
+            }
+
+            record[size++] = TSERIES_CTRL_RUN;
+        }
+        else
+        {
+            uint8_t code_t, code_vdd, code_temp;
+
+            size = 1;
+            size += tseries_field_put(&record[size], dod, &code_t);
+            size += tseries_field_put(&record[size], dvdd, &code_vdd);
+            size += tseries_field_put(&record[size], dtemp, &code_temp);
+            record[0] = code_t | (code_vdd << 2) | (code_temp << 4);
+        }
+
+        if (p_block->hdr.used + size <= TSERIES_DATA_SIZE)
+        {
+            tseries_enc.run = (record[0] & TSERIES_CTRL_RUN)?
+                    p_block->hdr.used: TSERIES_RUN_NONE;
+
+            memcpy(&p_block->data[p_block->hdr.used], record, size);
+            p_block->hdr.used += size;
+            p_block->hdr.count++;
+
+            tseries_enc.t = t;
+            tseries_enc.dt = dt;
+            tseries_enc.vdd = vdd;
+            tseries_enc.temp = temp;
+            return;
+        }
+
+        /*
+         * Block is full, record goes to the header of the next one
+         */
+        tseries_head = (tseries_head + 1) % CFG_TSERIES_BLOCK_COUNT;
+        p_block = &tseries_blocks[tseries_head];
+    }
+
+    if (tseries_blocks_used < CFG_TSERIES_BLOCK_COUNT)
+    {
+        tseries_blocks_used++;
+    }
+
+    p_block->hdr.t0 = t;
+    p_block->hdr.vdd0 = vdd;
+    p_block->hdr.temp0 = temp;
+    p_block->hdr.used = 0;
+    p_block->hdr.count = 1;
+    p_block->hdr.seq = tseries_seq++;
+
+    tseries_enc.t = t;
+    tseries_enc.dt = 0;
+    tseries_enc.vdd = vdd;
+    tseries_enc.temp = temp;
+    tseries_enc.run = TSERIES_RUN_NONE;
+}
+
+/*
+ * Sequential decoder, from the oldest record. Current block is decoded
+ * from a snapshot, so appends between decoder calls do not change it.
+ */
+typedef struct
+{
+    tseries_block_t block;      /* Snapshot of current block */
+    uint16_t next_block;
+    uint16_t next_seq;
+    uint16_t blocks_left;
+    uint16_t blocks_lost;       /* Overwritten before decoded */
+    uint16_t offset;
+    uint16_t records_left;
+    uint8_t run_left;
+    uint32_t records;           /* Records exported by dump */
+    uint32_t t;
+    int32_t dt;
+    int16_t vdd;
+    int32_t temp;
+} tseries_iter_t;
+
+static void tseries_iter_init(tseries_iter_t *p_iter)
+{
+    memset(p_iter, 0, sizeof(*p_iter));
+    p_iter->blocks_left = tseries_blocks_used;
+    p_iter->next_block = (tseries_head + CFG_TSERIES_BLOCK_COUNT + 1 -
+            tseries_blocks_used) % CFG_TSERIES_BLOCK_COUNT;
+    p_iter->next_seq = tseries_seq - tseries_blocks_used;
+}
+
+static bool tseries_iter_next(tseries_iter_t *p_iter)
+{
+    if (p_iter->records_left == 0)
+    {
+        /*
+         * Ring wrapped since iterator initialization: skip blocks
+         * overwritten by newer ones to the oldest one still kept
+         */
+        int16_t lost = (int16_t)(tseries_seq - tseries_blocks_used -
+                p_iter->next_seq);
+
+        if (lost > 0)
+        {
+            lost = MIN(lost, (int16_t)p_iter->blocks_left);
+            p_iter->next_block = (p_iter->next_block + lost) %
+                    CFG_TSERIES_BLOCK_COUNT;
+            p_iter->next_seq += lost;
+            p_iter->blocks_left -= lost;
+            p_iter->blocks_lost += lost;
+        }
+
+        if (p_iter->blocks_left == 0)
+        {
+            return false;
+        }
+
+        p_iter->block = tseries_blocks[p_iter->next_block];
+        p_iter->next_block = (p_iter->next_block + 1) %
+                CFG_TSERIES_BLOCK_COUNT;
+        p_iter->next_seq++;
+        p_iter->blocks_left--;
+
+        p_iter->offset = 0;
+        p_iter->records_left = p_iter->block.hdr.count - 1;
+        p_iter->run_left = 0;
+        p_iter->t = p_iter->block.hdr.t0;
+        p_iter->dt = 0;
+        p_iter->vdd = p_iter->block.hdr.vdd0;
+        p_iter->temp = p_iter->block.hdr.temp0;
+        return true;
+    }
+
+    p_iter->records_left--;
+
+    if (p_iter->run_left)
+    {
+        p_iter->run_left--;
+        p_iter->t += p_iter->dt;
+        return true;
+    }
+
+    uint8_t const *p_data = &p_iter->block.data[p_iter->offset];
+    uint8_t ctrl = *p_data++;
+    uint8_t size;
+
+    if (ctrl & TSERIES_CTRL_RUN)
+    {
+        p_iter->run_left = ctrl & TSERIES_CTRL_RUN_MAX;
+        p_iter->t += p_iter->dt;
+        p_iter->offset++;
+        return true;
+    }
+
+    p_iter->dt += tseries_field_get(p_data, ctrl & 0x03, &size);
+    p_iter->t += p_iter->dt;
+    p_data += size;
+    p_iter->vdd += tseries_field_get(p_data, (ctrl >> 2) & 0x03, &size);
+    p_data += size;
+    p_iter->temp += tseries_field_get(p_data, (ctrl >> 4) & 0x03, &size);
+    p_data += size;
+
+    p_iter->offset = p_data - p_iter->block.data;
+    return true;
+}
+
+/*
+ * @brief Function for exporting records of one block to log, called from
+ * main loop with iterator initialized by tseries_iter_init() until it
+ * returns false, so export of the whole ring does not block other tasks.
+ */
+static bool tseries_dump_step(tseries_iter_t *p_iter)
+{
+    while (tseries_iter_next(p_iter))
+    {
+        NRF_LOG_INFO("TSERIES: t %u ms vdd %d mV temp %d", p_iter->t,
+                p_iter->vdd, p_iter->temp);
+        p_iter->records++;
+
+        if (p_iter->records_left == 0 && p_iter->blocks_left)
+        {
+            return true;
+        }
+    }
+
+    NRF_LOG_INFO("TSERIES: %u records in %u blocks of %u bytes",
+            p_iter->records, tseries_blocks_used, TSERIES_BLOCK_SIZE);
+    if (p_iter->blocks_lost)
+    {
+        NRF_LOG_WARNING("TSERIES: %u blocks overwritten during export",
+                p_iter->blocks_lost);
+    }
+    return false;
+}
+#endif
+
+#if CFG_FLOG_ENABLED
+/*
+ * Append-only flash log of sample records
+ *
+ * Region of CFG_FLOG_PAGES pages at the end of flash is used as a ring of
+ * pages. Records are collected in RAM batch and written by whole batch,
+ * page starts with header of batch size, so every page holds integer
+ * number of batches. When head page is full the next page is erased
+ * (dropping the oldest one) and gets header with incremented sequence
+ * number, so erases are spread evenly over the region.
+ *
+ * On init page headers are scanned: head is the page with the highest
+ * sequence number, write offset is the first fully erased batch slot in
+ * it. Batch interrupted by power loss is left as used slot.
+ *
+ * NVMC backend executes operations synchronously, page erase stalls CPU
+ * for up to ~90 ms.
+ *
+ * Region is cut from FLASH in the linker scripts, so code can not grow
+ * into it. History is read back by walking pages from the oldest one,
+ * one batch per step.
+ */
+#define FLOG_MAGIC 0x474F4C46           /* "FLOG" */
+#define FLOG_VERSION 1
+#define FLOG_INDEX_ERASED 0xFFFFFFFF
+#define FLOG_DUMP_PAUSE_MS 10
+
+typedef struct
+{
+    uint32_t index;             /* record number, continues over resets */
+    int16_t vdd;                /* mV */
+    int16_t temp;               /* 0.01 C */
+} flog_record_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;               /* page sequence number */
+    uint32_t first_index;       /* index of the first record in page */
+    uint16_t version;
+    uint16_t record_size;
+} flog_page_hdr_t;
+
+#define FLOG_BATCH_SIZE (CFG_FLOG_BATCH_RECORDS * sizeof(flog_record_t))
+
+STATIC_ASSERT(sizeof(flog_page_hdr_t) <= FLOG_BATCH_SIZE);
+STATIC_ASSERT(FLOG_BATCH_SIZE % sizeof(uint32_t) == 0);
+
+static void flog_fstorage_evt_handler(nrf_fstorage_evt_t *p_evt);
+
+NRF_FSTORAGE_DEF(nrf_fstorage_t flog_fstorage) =
+{
+    .evt_handler = flog_fstorage_evt_handler,
+};
+
+static uint32_t flog_page_size;
+static uint16_t flog_head;              /* head page */
+static uint32_t flog_head_seq;
+static uint32_t flog_offset;            /* write offset in head page */
+static uint32_t flog_index;             /* next record index */
+
+static flog_page_hdr_t flog_hdr;
+static flog_record_t flog_batch[CFG_FLOG_BATCH_RECORDS];
+
+/*
+ * Read back iterator
+ */
+typedef struct
+{
+    uint16_t page;
+    uint16_t pages_left;
+    uint32_t offset;            /* 0: page header not checked yet */
+    uint32_t records;
+} flog_iter_t;
+static uint8_t flog_batch_count;
+static uint8_t flog_pending;            /* flash operations in flight */
+static uint32_t flog_dropped;
+
+static uint32_t flog_page_addr(uint16_t page)
+{
+    return flog_fstorage.start_addr + page * flog_page_size;
+}
+
+static void flog_fstorage_evt_handler(nrf_fstorage_evt_t *p_evt)
+{
+    if (p_evt->result != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("FLOG: operation %d at 0x%x failed", p_evt->id,
+                p_evt->addr);
+    }
+
+    flog_pending--;
+}
+
+static bool flog_page_valid(uint16_t page)
+{
+    flog_page_hdr_t const *p_hdr =
+            (flog_page_hdr_t const *)flog_page_addr(page);
+
+    return (p_hdr->magic == FLOG_MAGIC) &&
+            (p_hdr->version == FLOG_VERSION) &&
+            (p_hdr->record_size == sizeof(flog_record_t));
+}
+
+static bool flog_slot_erased(uint32_t addr)
+{
+    uint32_t const *p_word = (uint32_t const *)addr;
+
+    for (uint32_t i = 0; i < FLOG_BATCH_SIZE / sizeof(uint32_t); i++)
+    {
+        if (p_word[i] != 0xFFFFFFFF)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * @brief Function for erasing the next page and making it the head.
+ */
+static void flog_page_open(void)
+{
+    ret_code_t err_code;
+
+    flog_head = (flog_head + 1) % CFG_FLOG_PAGES;
+    flog_head_seq++;
+    flog_offset = FLOG_BATCH_SIZE;
+
+    flog_hdr.magic = FLOG_MAGIC;
+    flog_hdr.seq = flog_head_seq;
+    flog_hdr.first_index = flog_index;
+    flog_hdr.version = FLOG_VERSION;
+    flog_hdr.record_size = sizeof(flog_record_t);
+
+    flog_pending++;
+    err_code = nrf_fstorage_erase(&flog_fstorage,
+            flog_page_addr(flog_head), 1, NULL);
+    APP_ERROR_CHECK(err_code);
+
+    flog_pending++;
+    err_code = nrf_fstorage_write(&flog_fstorage, flog_page_addr(flog_head),
+            &flog_hdr, sizeof(flog_hdr), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+/*
+ * @brief Function for appending record, called from main loop.
+ *
+ * Flash is written when batch is full.
+ */
+static void flog_append(int16_t vdd, int16_t temp)
+{
+    ret_code_t err_code;
+
+    if (flog_pending)
+    {
+        /*
+         * Batch is being written (asynchronous backends only)
+         */
+        flog_dropped++;
+        return;
+    }
+
+    flog_batch[flog_batch_count].index = flog_index++;
+    flog_batch[flog_batch_count].vdd = vdd;
+    flog_batch[flog_batch_count].temp = temp;
+
+    if (++flog_batch_count < CFG_FLOG_BATCH_RECORDS)
+    {
+        return;
+    }
+
+    if (flog_offset == flog_page_size)
+    {
+        flog_page_open();
+    }
+
+    flog_pending++;
+    err_code = nrf_fstorage_write(&flog_fstorage,
+            flog_page_addr(flog_head) + flog_offset, flog_batch,
+            FLOG_BATCH_SIZE, NULL);
+    APP_ERROR_CHECK(err_code);
+
+    /*
+     * Batch is not touched until the write is done
+     */
+    flog_batch_count = 0;
+    flog_offset += FLOG_BATCH_SIZE;
+}
+
+/*
+ * @brief Function for recovering head page and write offset.
+ */
+static void flog_recover(void)
+{
+    bool found = false;
+
+    for (uint16_t page = 0; page < CFG_FLOG_PAGES; page++)
+    {
+        flog_page_hdr_t const *p_hdr =
+                (flog_page_hdr_t const *)flog_page_addr(page);
+
+        if (!flog_page_valid(page))
+        {
+            continue;
+        }
+
+        if (!found || (int32_t)(p_hdr->seq - flog_head_seq) > 0)
+        {
+            flog_head = page;
+            flog_head_seq = p_hdr->seq;
+            flog_index = p_hdr->first_index;
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        /*
+         * Empty region: the first page opened is page 0
+         */
+        flog_head = CFG_FLOG_PAGES - 1;
+        flog_head_seq = 0;
+        flog_index = 0;
+        flog_offset = flog_page_size;
+        return;
+    }
+
+    for (flog_offset = FLOG_BATCH_SIZE; flog_offset < flog_page_size;
+            flog_offset += FLOG_BATCH_SIZE)
+    {
+        uint32_t addr = flog_page_addr(flog_head) + flog_offset;
+
+        if (flog_slot_erased(addr))
+        {
+            break;
+        }
+    }
+
+    /*
+     * Every slot after the header holds one whole batch, so index is
+     * derived from the slot count: batch cut short by reset does not
+     * have valid last index, but still takes its slot
+     */
+    flog_index += (flog_offset / FLOG_BATCH_SIZE - 1) *
+            CFG_FLOG_BATCH_RECORDS;
+
+    NRF_LOG_INFO("FLOG: head page %d seq %u offset %u, next record %u",
+            flog_head, flog_head_seq, flog_offset, flog_index);
+}
+
+static void flog_iter_init(flog_iter_t *p_iter)
+{
+    memset(p_iter, 0, sizeof(*p_iter));
+    p_iter->page = (flog_head + 1) % CFG_FLOG_PAGES;
+    p_iter->pages_left = CFG_FLOG_PAGES;
+}
+
+/*
+ * @brief Function for exporting records of one batch slot to log, called
+ * from main loop with iterator initialized by flog_iter_init() until it
+ * returns false.
+ *
+ * Slots of the head page are read up to write offset, records of batch
+ * cut short by reset are left erased and skipped.
+ */
+static bool flog_dump_step(flog_iter_t *p_iter)
+{
+    while (p_iter->pages_left)
+    {
+        uint32_t addr = flog_page_addr(p_iter->page);
+        uint32_t end = (p_iter->page == flog_head)?
+                flog_offset: flog_page_size;
+
+        if (p_iter->offset == 0)
+        {
+            p_iter->offset = flog_page_valid(p_iter->page)?
+                    FLOG_BATCH_SIZE: end;
+        }
+
+        if (p_iter->offset < end)
+        {
+            flog_record_t const *p_record =
+                    (flog_record_t const *)(addr + p_iter->offset);
+
+            for (uint8_t i = 0; i < CFG_FLOG_BATCH_RECORDS; i++)
+            {
+                if (p_record[i].index == FLOG_INDEX_ERASED)
+                {
+                    continue;
+                }
+
+                NRF_LOG_INFO("FLOG: record %u vdd %d mV temp %d",
+                        p_record[i].index, p_record[i].vdd,
+                        p_record[i].temp);
+                p_iter->records++;
+            }
+
+            p_iter->offset += FLOG_BATCH_SIZE;
+            return true;
+        }
+
+        p_iter->page = (p_iter->page + 1) % CFG_FLOG_PAGES;
+        p_iter->pages_left--;
+        p_iter->offset = 0;
+    }
+
+    NRF_LOG_INFO("FLOG: %u records read back, head page %d seq %u, "
+            "next record %u, %u dropped", p_iter->records, flog_head,
+            flog_head_seq, flog_index, flog_dropped);
+    return false;
+}
+
+static void flog_init(void)
+{
+    ret_code_t err_code;
+    uint32_t flash_end;
+
+    flog_page_size = NRF_FICR->CODEPAGESIZE;
+    flash_end = NRF_FICR->CODEPAGESIZE * NRF_FICR->CODESIZE;
+    NRFX_ASSERT(flog_page_size % FLOG_BATCH_SIZE == 0);
+
+    flog_fstorage.start_addr = flash_end - CFG_FLOG_PAGES * flog_page_size;
+    flog_fstorage.end_addr = flash_end;
+
+    err_code = nrf_fstorage_init(&flog_fstorage, &nrf_fstorage_nvmc, NULL);
+    APP_ERROR_CHECK(err_code);
+
+    flog_recover();
+}
+#endif
+
+/*
+ * SAADC to millivolt conversion kernels
+ *
+ * Result is raw * full_scale / 2^bits, where full scale is 0.6 V internal
+ * reference divided by gain and bits is resolution (one bit less in
+ * differential mode). Scale is folded at compile time into Q15 (or Q11,
+ * if LSB is 1 mV or more) 16-bit constant, so two samples are converted
+ * by packed 16x16 multiplies and the sum for batch mean is accumulated
+ * by SMLAD.
+ */
+#define SAADC_RESOLUTION_BITS (8 + 2 * NRFX_SAADC_CONFIG_RESOLUTION)
+
+#define SAADC_MV_SHIFT(fs_mv, bits) (((fs_mv) < (1 << (bits)))? 15: 11)
+#define SAADC_MV_SCALE(fs_mv, bits) \
+    ((int16_t)(((fs_mv) << SAADC_MV_SHIFT(fs_mv, bits)) >> (bits)))
+
+typedef int32_t (*saadc_mv_kernel_t)(int16_t const *p_in, int16_t *p_out,
+        uint16_t count);
+
+/*
+ * Converts count values, p_out may be the same as p_in. Returns sum of
+ * converted values.
+ */
+__STATIC_FORCEINLINE int32_t saadc_mv_convert(int16_t const *p_in,
+        int16_t *p_out, uint16_t count, int16_t scale, uint8_t shift)
+{
+    int32_t half = 1 << (shift - 1);
+    int32_t sum = 0;
+    uint16_t i = 0;
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+    /*
+     * Upper half of k is zero, so dual multiply-add gives low product and
+     * exchanged one gives high product
+     */
+    uint32_t k = (uint16_t)scale;
+
+    for (; i + 1 < count; i += 2)
+    {
+        uint32_t x = __UNALIGNED_UINT32_READ(&p_in[i]);
+        int32_t lo = ((int32_t)__SMUAD(x, k) + half) >> shift;
+        int32_t hi = ((int32_t)__SMUADX(x, k) + half) >> shift;
+        uint32_t y = __PKHBT((uint32_t)lo, (uint32_t)hi, 16);
+
+        __UNALIGNED_UINT32_WRITE(&p_out[i], y);
+        sum = __SMLAD(y, 0x00010001, sum);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        p_out[i] = (int16_t)((p_in[i] * scale + half) >> shift);
+        sum += p_out[i];
+    }
+
+    return sum;
+}
+
+#define SAADC_MV_KERNEL_DEF(name, fs_mv, bits) \
+    static int32_t name(int16_t const *p_in, int16_t *p_out, \
+            uint16_t count) \
+    { \
+        STATIC_ASSERT(SAADC_MV_SCALE(fs_mv, bits) > 0); \
+        return saadc_mv_convert(p_in, p_out, count, \
+                SAADC_MV_SCALE(fs_mv, bits), SAADC_MV_SHIFT(fs_mv, bits)); \
+    }
+
+/*
+ * Kernels for used gain and mode combinations
+ */
+SAADC_MV_KERNEL_DEF(saadc_mv_gain1_6_se, 3600, SAADC_RESOLUTION_BITS)
+SAADC_MV_KERNEL_DEF(saadc_mv_gain1_2_diff, 1200, SAADC_RESOLUTION_BITS - 1)
+
+/*
+ * SAADC scan channels: every trigger converts all of them in one scan.
+ * With hardware oversampling (NRFX_SAADC_CONFIG_OVERSAMPLE) in scan mode
+ * burst must be enabled on every channel. Software oversampling is per
+ * channel: 2^oversample scans are averaged to one result.
+ */
+typedef enum
+{
+    SAADC_CH_VDD,
+    SAADC_CH_AIN0,
+    SAADC_CH_AIN4_AIN5,
+    SAADC_CHANNEL_COUNT
+} saadc_channel_id_t;
+
+typedef struct
+{
+    nrf_saadc_input_t pin_p;
+    nrf_saadc_input_t pin_n;        /* NRF_SAADC_INPUT_DISABLED: single ended */
+    nrf_saadc_gain_t gain;
+    nrf_saadc_acqtime_t acq_time;
+    nrf_saadc_burst_t burst;
+    uint8_t oversample;             /* log2 of scans per result */
+    saadc_mv_kernel_t to_mv;        /* must match gain and mode */
+} saadc_channel_config_t;
+
+static const saadc_channel_config_t saadc_channels_config[SAADC_CHANNEL_COUNT] =
+{
+    [SAADC_CH_VDD] =
+    {
+        .pin_p = NRF_SAADC_INPUT_VDD,
+        .pin_n = NRF_SAADC_INPUT_DISABLED,
+        .gain = NRF_SAADC_GAIN1_6,
+        .acq_time = NRF_SAADC_ACQTIME_20US,
+        .burst = NRF_SAADC_BURST_ENABLED,
+        .oversample = 2,
+        .to_mv = saadc_mv_gain1_6_se
+    },
+    [SAADC_CH_AIN0] =
+    {
+        .pin_p = NRF_SAADC_INPUT_AIN0,
+        .pin_n = NRF_SAADC_INPUT_DISABLED,
+        .gain = NRF_SAADC_GAIN1_6,
+        .acq_time = NRF_SAADC_ACQTIME_10US,
+        .burst = NRF_SAADC_BURST_ENABLED,
+        .oversample = 0,
+        .to_mv = saadc_mv_gain1_6_se
+    },
+    [SAADC_CH_AIN4_AIN5] =
+    {
+        .pin_p = NRF_SAADC_INPUT_AIN4,
+        .pin_n = NRF_SAADC_INPUT_AIN5,
+        .gain = NRF_SAADC_GAIN1_2,
+        .acq_time = NRF_SAADC_ACQTIME_40US,
+        .burst = NRF_SAADC_BURST_ENABLED,
+        .oversample = 1,
+        .to_mv = saadc_mv_gain1_2_diff
+    },
+};
+
+/*
+ * The last VDD value, mV
+ */
+static int16_t saadc_vdd_mv;
+
+uint16_t saadc_sample()
+{
+    nrfx_err_t err_code;
+    nrf_saadc_value_t result = 0;
+    int16_t mv;
+
+    err_code = nrfx_saadc_sample_convert(SAADC_CH_VDD, &result);
+    APP_ERROR_CHECK(err_code);
+
+    saadc_channels_config[SAADC_CH_VDD].to_mv(&result, &mv, 1);
+
+    NRF_LOG_INFO("SAADC: VDD value %d mV", mv);
+#if CFG_STATS_ENABLED
+    stats_add(STATS_VDD, mv);
+#endif
+    saadc_vdd_mv = mv;
+    return result;
+}
+
+#if CFG_SAADC_CONTINUOUS
+STATIC_ASSERT(IS_POWER_OF_TWO(CFG_SAADC_BUFFER_SIZE));
+
+#define SAADC_SCAN_BUFFER_SIZE (SAADC_CHANNEL_COUNT * CFG_SAADC_BUFFER_SIZE)
+
+/*
+ * Double buffer of interleaved scans, one is filled by EasyDMA while the
+ * other one is processed by main loop
+ */
+static nrf_saadc_value_t saadc_buffers[2][SAADC_SCAN_BUFFER_SIZE];
+
+/*
+ * De-interleaved results: contiguous array per channel with
+ * saadc_results_count[ch] oversampled values, converted to mV in place
+ */
+static int16_t saadc_results[SAADC_CHANNEL_COUNT][CFG_SAADC_BUFFER_SIZE];
+static uint16_t saadc_results_count[SAADC_CHANNEL_COUNT];
+
+/*
+ * Per channel mean of the last filled buffer, mV
+ */
+static int32_t saadc_means[SAADC_CHANNEL_COUNT];
+
+/*
+ * @brief Function for de-interleaving and oversampling one channel of
+ * the scan buffer.
+ */
+static uint16_t saadc_channel_extract(nrf_saadc_value_t const *p_scan,
+        uint8_t channel, int16_t *p_result)
+{
+    uint8_t oversample = saadc_channels_config[channel].oversample;
+    uint16_t count = CFG_SAADC_BUFFER_SIZE >> oversample;
+
+    p_scan += channel;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        int32_t sum = 0;
+
+        for (uint16_t j = 0; j < (1u << oversample); j++)
+        {
+            sum += *p_scan;
+            p_scan += SAADC_CHANNEL_COUNT;
+        }
+        p_result[i] = (int16_t)(sum >> oversample);
+    }
+
+    return count;
+}
+
+/*
+ * Buffers owned by the driver. Pause request (recalibration, burst
+ * capture) stops requeueing, requested action starts when both buffers
+ * are returned, so no buffer is aborted in the middle.
+ */
+typedef enum
+{
+    SAADC_PAUSE_NONE,
+    SAADC_PAUSE_RECAL,
+    SAADC_PAUSE_CAPTURE,
+} saadc_pause_t;
+
+static uint8_t saadc_buffers_queued;
+static saadc_pause_t saadc_pause_request;
+
+#if CFG_CAPTURE_ENABLED
+static void capture_start(void);
+#endif
+
+static void saadc_paused(void)
+{
+    nrfx_err_t err_code;
+
+    nrfx_rtc_disable(&rtc2);
+
+    switch (saadc_pause_request)
+    {
+        case SAADC_PAUSE_RECAL:
+            /*
+             * Acquisition is restarted by CALIBRATEDONE event
+             */
+            err_code = nrfx_saadc_calibrate_offset();
+            APP_ERROR_CHECK(err_code);
+            break;
+#if CFG_CAPTURE_ENABLED
+        case SAADC_PAUSE_CAPTURE:
+            /*
+             * Acquisition is restarted when capture is done
+             */
+            capture_start();
+            break;
+#endif
+        default:
+            break;
+    }
+
+    saadc_pause_request = SAADC_PAUSE_NONE;
+}
+
+/*
+ * @brief Function for processing filled SAADC buffer in main loop and
+ * giving it back to the driver.
+ */
+static void saadc_buffer_process(uint8_t index)
+{
+    nrfx_err_t err_code;
+    nrf_saadc_value_t *p_buffer = saadc_buffers[index];
+
+    for (uint8_t ch = 0; ch < SAADC_CHANNEL_COUNT; ch++)
+    {
+        saadc_results_count[ch] =
+                saadc_channel_extract(p_buffer, ch, saadc_results[ch]);
+    }
+
+    /*
+     * Scan buffer is not needed anymore and is queued back. If the other
+     * buffer is already filled too, driver has no buffer and is idle, so
+     * queuing this one starts it again; samples triggered meanwhile are
+     * lost.
+     */
+    saadc_buffers_queued--;
+    if (saadc_pause_request == SAADC_PAUSE_NONE)
+    {
+        err_code = nrfx_saadc_buffer_convert(p_buffer,
+                SAADC_SCAN_BUFFER_SIZE);
+        APP_ERROR_CHECK(err_code);
+        saadc_buffers_queued++;
+    }
+    else if (saadc_buffers_queued == 0)
+    {
+        saadc_paused();
+    }
+
+    /*
+     * Results are converted to mV in place
+     */
+    for (uint8_t ch = 0; ch < SAADC_CHANNEL_COUNT; ch++)
+    {
+        uint16_t count = saadc_results_count[ch];
+        int32_t sum = saadc_channels_config[ch].to_mv(saadc_results[ch],
+                saadc_results[ch], count);
+
+        saadc_means[ch] = sum / count;
+    }
+    saadc_vdd_mv = saadc_means[SAADC_CH_VDD];
+
+#if CFG_STATS_ENABLED
+    for (uint16_t i = 0; i < saadc_results_count[SAADC_CH_VDD]; i++)
+    {
+        stats_add(STATS_VDD, saadc_results[SAADC_CH_VDD][i]);
+    }
+#endif
+}
+
+/*
+ * @brief Function for starting continuous acquisition, called when
+ * offset calibration is done.
+ */
+static void saadc_acquisition_start(void)
+{
+    nrfx_err_t err_code;
+
+    err_code = nrfx_saadc_buffer_convert(saadc_buffers[0],
+            SAADC_SCAN_BUFFER_SIZE);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_saadc_buffer_convert(saadc_buffers[1],
+            SAADC_SCAN_BUFFER_SIZE);
+    APP_ERROR_CHECK(err_code);
+
+    saadc_buffers_queued = 2;
+
+    nrfx_rtc_enable(&rtc2);
+}
+#endif
+
+/*
+ * Die temperature at the last offset calibration, 0.01 C
+ */
+static int32_t saadc_calib_temp;
+static bool saadc_calib_temp_valid;
+
+#if CFG_CAPTURE_ENABLED
+/*
+ * Burst capture is armed or running, SAADC driver is not used
+ */
+static bool capture_active;
+#endif
+
+/*
+ * @brief Function for checking temperature drift since the last offset
+ * calibration, called from main loop on every TEMP result.
+ */
+static void saadc_temp_update(int32_t temp)
+{
+    int32_t delta = temp - saadc_calib_temp;
+
+#if CFG_CAPTURE_ENABLED
+    /*
+     * Calibration is done anyway when capture is finished
+     */
+    if (capture_active)
+    {
+        return;
+    }
+#endif
+
+    /*
+     * Initial calibration is done before the first TEMP result
+     */
+    if (!saadc_calib_temp_valid)
+    {
+        saadc_calib_temp = temp;
+        saadc_calib_temp_valid = true;
+        return;
+    }
+
+    if (delta < CFG_SAADC_RECAL_TEMP_DELTA &&
+            delta > -CFG_SAADC_RECAL_TEMP_DELTA)
+    {
+        return;
+    }
+
+    NRF_LOG_INFO("SAADC: offset recalibration, temperature delta %d C",
+            delta / 100);
+    saadc_calib_temp = temp;
+
+#if CFG_SAADC_CONTINUOUS
+    /*
+     * Sampling is paused when both buffers are returned
+     */
+    if (saadc_pause_request == SAADC_PAUSE_NONE)
+    {
+        saadc_pause_request = SAADC_PAUSE_RECAL;
+    }
+#else
+    nrfx_err_t err_code;
+
+    err_code = nrfx_saadc_calibrate_offset();
+    APP_ERROR_CHECK(err_code);
+#endif
+}
+
+#if CFG_VDD_ALARM_ENABLED
+/*
+ * VDD alarm by SAADC channel limits
+ *
+ * Limits are checked by SAADC on every conversion of VDD channel, CPU is
+ * interrupted only when VDD leaves the band. Limits are disabled on the
+ * first LIMIT event and programmed again for the new state after
+ * CFG_VDD_ALARM_REARM_MS, with hysteresis for return to normal state.
+ */
+#define VDD_ALARM_MV_TO_RAW(mv) \
+    ((int16_t)((int32_t)(mv) * (1 << SAADC_RESOLUTION_BITS) / 3600))
+
+typedef enum
+{
+    VDD_ALARM_NORMAL,
+    VDD_ALARM_LOW,
+    VDD_ALARM_HIGH,
+} vdd_alarm_state_t;
+
+static const char * const vdd_alarm_names[] =
+{
+    [VDD_ALARM_NORMAL] = "normal",
+    [VDD_ALARM_LOW] = "low",
+    [VDD_ALARM_HIGH] = "high",
+};
+
+/*
+ * Changed by main loop only
+ */
+static vdd_alarm_state_t vdd_alarm_state;
+
+static void vdd_alarm_apply(void)
+{
+    int16_t low = NRFX_SAADC_LIMITL_DISABLED;
+    int16_t high = NRFX_SAADC_LIMITH_DISABLED;
+
+    switch (vdd_alarm_state)
+    {
+        case VDD_ALARM_NORMAL:
+            low = VDD_ALARM_MV_TO_RAW(CFG_VDD_ALARM_LOW_MV);
+            high = VDD_ALARM_MV_TO_RAW(CFG_VDD_ALARM_HIGH_MV);
+            break;
+        case VDD_ALARM_LOW:
+            high = VDD_ALARM_MV_TO_RAW(CFG_VDD_ALARM_LOW_MV +
+                    CFG_VDD_ALARM_HYST_MV);
+            break;
+        case VDD_ALARM_HIGH:
+            low = VDD_ALARM_MV_TO_RAW(CFG_VDD_ALARM_HIGH_MV -
+                    CFG_VDD_ALARM_HYST_MV);
+            break;
+    }
+
+    nrfx_saadc_limits_set(SAADC_CH_VDD, low, high);
+}
+
+/*
+ * Called by SAADC handler, the limit stays disabled until rearm
+ */
+static void vdd_alarm_disarm(void)
+{
+    nrfx_saadc_limits_set(SAADC_CH_VDD, NRFX_SAADC_LIMITL_DISABLED,
+            NRFX_SAADC_LIMITH_DISABLED);
+}
+
+static void vdd_alarm_rearm_handler(void *p_context)
+{
+#if CFG_CAPTURE_ENABLED
+    /*
+     * Limits are applied by saadc_init() when capture is done
+     */
+    if (capture_active)
+    {
+        return;
+    }
+#endif
+
+    vdd_alarm_apply();
+}
+
+static vtimer_t vdd_alarm_rearm_timer =
+        VTIMER_INIT(vdd_alarm_rearm_handler, NULL);
+
+/*
+ * @brief Function for processing limit crossing, called from main loop.
+ */
+static void vdd_alarm_process(nrf_saadc_limit_t limit)
+{
+    vdd_alarm_state_t state = vdd_alarm_state;
+
+    if (limit == NRF_SAADC_LIMIT_LOW)
+    {
+        state = (state == VDD_ALARM_HIGH)? VDD_ALARM_NORMAL: VDD_ALARM_LOW;
+    }
+    else
+    {
+        state = (state == VDD_ALARM_LOW)? VDD_ALARM_NORMAL: VDD_ALARM_HIGH;
+    }
+
+    if (state != vdd_alarm_state)
+    {
+        NRF_LOG_WARNING("VDD: %s -> %s", vdd_alarm_names[vdd_alarm_state],
+                vdd_alarm_names[state]);
+        vdd_alarm_state = state;
+    }
+
+    vtimer_start(&vdd_alarm_rearm_timer,
+            TIMEBASE_MS_TO_TICKS(CFG_VDD_ALARM_REARM_MS), 0);
+}
+#endif
+
+#if CFG_CAPTURE_ENABLED
+/*
+ * Burst capture around probe edge
+ *
+ * SAADC samples CFG_CAPTURE_INPUT by its internal timer into circular
+ * buffer (END restarts DMA through PPI, a sample may be lost on every
+ * wrap). Probe edge starts TIMER4, which counts RESULTDONE events and
+ * after CFG_CAPTURE_POST_SAMPLES stops SAADC and disables restart and
+ * trigger channels through PPI group, so the buffer keeps
+ * CFG_CAPTURE_PRE_SAMPLES before the edge too. Triggers are enabled when
+ * the buffer is filled once.
+ *
+ * SAADC driver is uninitialized while capture runs and initialized back,
+ * with offset calibration, when it is done or when there is no probe edge
+ * within CFG_CAPTURE_ARM_TIMEOUT_MS. Trigger channels also set
+ * TRIGGERED1 of EGU3 (no interrupt) through PPI fork, so disarm knows if
+ * TIMER4 was started even before its first count.
+ */
+#define CAPTURE_BUFFER_SIZE \
+    (CFG_CAPTURE_PRE_SAMPLES + CFG_CAPTURE_POST_SAMPLES)
+#define CAPTURE_SAMPLERATE_CC (16000000 / CFG_CAPTURE_RATE_HZ)
+#define CAPTURE_BUFFER_MS (CAPTURE_BUFFER_SIZE * 1000 / CFG_CAPTURE_RATE_HZ + 1)
+#define CAPTURE_FILL_DELAY \
+    (TIMEBASE_MS_TO_TICKS(CAPTURE_BUFFER_MS) + RTC_CC_MIN_DELTA)
+
+/*
+ * SAADC event wait bound in loop iterations, as in SAADC driver
+ */
+#define CAPTURE_HW_TIMEOUT 10000
+
+#define CAPTURE_EDGE_EGU NRF_EGU3
+#define CAPTURE_EDGE_EGU_CHANNEL 1
+
+STATIC_ASSERT(CAPTURE_SAMPLERATE_CC >= 80 && CAPTURE_SAMPLERATE_CC <= 2047);
+STATIC_ASSERT(CFG_CAPTURE_POST_SAMPLES > 0 &&
+        CFG_CAPTURE_POST_SAMPLES <= UINT16_MAX);
+
+/*
+ * Must match gain of capture channel
+ */
+#define CAPTURE_TO_MV saadc_mv_gain1_6_se
+
+const nrfx_timer_t timer4 = NRFX_TIMER_INSTANCE(4);
+
+void saadc_init(void);
+
+static nrf_saadc_value_t capture_buffer[CAPTURE_BUFFER_SIZE];
+
+static const nrfx_gpiote_pin_t capture_trigger_pins[] =
+{
+    IN_PROBE_1,
+    IN_PROBE_2
+};
+
+#define CAPTURE_TRIGGER_COUNT ARRAY_SIZE(capture_trigger_pins)
+
+static nrf_ppi_channel_t capture_ppi_count;     /* RESULTDONE -> COUNT */
+static nrf_ppi_channel_t capture_ppi_stop;      /* COMPARE0 -> STOP */
+static nrf_ppi_channel_t capture_ppi_restart;   /* END -> START */
+static nrf_ppi_channel_t capture_ppi_trigger[CAPTURE_TRIGGER_COUNT];
+
+/*
+ * Restart and trigger channels
+ */
+static nrf_ppi_channel_group_t capture_ppi_group;
+
+static void capture_fill_handler(void *p_context)
+{
+    (void)nrfx_ppi_group_enable(capture_ppi_group);
+}
+
+static vtimer_t capture_fill_timer = VTIMER_INIT(capture_fill_handler, NULL);
+
+/*
+ * APP_EVT_CAPTURE sources
+ */
+#define CAPTURE_EVT_DONE 0
+#define CAPTURE_EVT_TIMEOUT 1
+
+static void capture_timeout_handler(void *p_context)
+{
+    app_evt_put(APP_EVT_CAPTURE, CAPTURE_EVT_TIMEOUT, 0);
+}
+
+static vtimer_t capture_timeout_timer =
+        VTIMER_INIT(capture_timeout_handler, NULL);
+
+static void capture_timer_event_handler(nrf_timer_event_t event_type,
+        void *p_context)
+{
+    if (event_type == NRF_TIMER_EVENT_COMPARE0)
+    {
+        app_evt_put(APP_EVT_CAPTURE, CAPTURE_EVT_DONE, 0);
+    }
+}
+
+/*
+ * @return false if event did not come within CAPTURE_HW_TIMEOUT.
+ */
+static bool capture_saadc_wait(nrf_saadc_event_t event)
+{
+    uint32_t timeout = CAPTURE_HW_TIMEOUT;
+
+    while (!nrf_saadc_event_check(event) && (timeout > 0))
+    {
+        timeout--;
+    }
+
+    return nrf_saadc_event_check(event);
+}
+
+/*
+ * @brief Function for stopping capture without probe edge and
+ * initializing SAADC driver back.
+ */
+static void capture_abort(void)
+{
+    vtimer_stop(&capture_fill_timer);
+    vtimer_stop(&capture_timeout_timer);
+
+    (void)nrfx_ppi_group_disable(capture_ppi_group);
+    (void)nrfx_ppi_channel_disable(capture_ppi_count);
+    (void)nrfx_ppi_channel_disable(capture_ppi_stop);
+
+    nrfx_timer_pause(&timer4);
+    nrfx_timer_clear(&timer4);
+
+    nrf_saadc_task_trigger(NRF_SAADC_TASK_STOP);
+    if (!capture_saadc_wait(NRF_SAADC_EVENT_STOPPED))
+    {
+        NRF_LOG_WARNING("CAPTURE: SAADC stop timeout");
+    }
+
+    nrf_saadc_continuous_mode_disable();
+    nrf_saadc_disable();
+
+    capture_active = false;
+    saadc_calib_temp_valid = false;
+    saadc_init();
+}
+
+/*
+ * @brief Function for starting capture when SAADC acquisition is paused.
+ */
+static void capture_start(void)
+{
+    nrf_saadc_channel_config_t config_ch =
+            NRFX_SAADC_DEFAULT_CHANNEL_CONFIG_SE(CFG_CAPTURE_INPUT);
+
+    config_ch.acq_time = NRF_SAADC_ACQTIME_3US;
+
+    nrfx_saadc_uninit();
+
+    nrf_saadc_resolution_set(
+            (nrf_saadc_resolution_t)NRFX_SAADC_CONFIG_RESOLUTION);
+    nrf_saadc_oversample_set(NRF_SAADC_OVERSAMPLE_DISABLED);
+    nrf_saadc_channel_init(0, &config_ch);
+    nrf_saadc_continuous_mode_enable(CAPTURE_SAMPLERATE_CC);
+    nrf_saadc_buffer_init(capture_buffer, CAPTURE_BUFFER_SIZE);
+    nrf_saadc_event_clear(NRF_SAADC_EVENT_STARTED);
+    nrf_saadc_event_clear(NRF_SAADC_EVENT_STOPPED);
+    nrf_saadc_enable();
+
+    nrfx_timer_clear(&timer4);
+    nrf_egu_event_clear(CAPTURE_EDGE_EGU,
+            nrf_egu_event_triggered_get(CAPTURE_EDGE_EGU,
+                    CAPTURE_EDGE_EGU_CHANNEL));
+    (void)nrfx_ppi_channel_enable(capture_ppi_count);
+    (void)nrfx_ppi_channel_enable(capture_ppi_stop);
+    (void)nrfx_ppi_channel_enable(capture_ppi_restart);
+
+    /*
+     * SAMPLE task starts internal timer
+     */
+    nrf_saadc_task_trigger(NRF_SAADC_TASK_START);
+    if (!capture_saadc_wait(NRF_SAADC_EVENT_STARTED))
+    {
+        NRF_LOG_WARNING("CAPTURE: SAADC start timeout");
+        capture_abort();
+        return;
+    }
+    nrf_saadc_task_trigger(NRF_SAADC_TASK_SAMPLE);
+
+    vtimer_start(&capture_fill_timer, CAPTURE_FILL_DELAY, 0);
+    vtimer_start(&capture_timeout_timer,
+            TIMEBASE_MS_TO_TICKS(CFG_CAPTURE_ARM_TIMEOUT_MS), 0);
+
+    NRF_LOG_INFO("CAPTURE: armed, %d samples at %d Hz",
+            CAPTURE_BUFFER_SIZE, CFG_CAPTURE_RATE_HZ);
+}
+
+/*
+ * @brief Function for arming capture, called from main loop.
+ */
+static void capture_arm(void)
+{
+    if (capture_active)
+    {
+        return;
+    }
+
+#if CFG_SAADC_CONTINUOUS
+    if (saadc_pause_request != SAADC_PAUSE_NONE)
+    {
+        return;
+    }
+
+    /*
+     * Capture starts when both acquisition buffers are returned
+     */
+    capture_active = true;
+    saadc_pause_request = SAADC_PAUSE_CAPTURE;
+#else
+    capture_active = true;
+    capture_start();
+#endif
+}
+
+/*
+ * @brief Function for processing captured samples, called from main loop.
+ */
+static void capture_done(void)
+{
+    uint16_t oldest;
+    int16_t pre_min = INT16_MAX, pre_max = INT16_MIN;
+    int16_t post_min = INT16_MAX, post_max = INT16_MIN;
+
+    if (!capture_active)
+    {
+        return;
+    }
+
+    vtimer_stop(&capture_timeout_timer);
+
+    /*
+     * STOP is triggered by PPI
+     */
+    if (!capture_saadc_wait(NRF_SAADC_EVENT_STOPPED))
+    {
+        NRF_LOG_WARNING("CAPTURE: SAADC stop timeout");
+    }
+
+    (void)nrfx_ppi_channel_disable(capture_ppi_count);
+    (void)nrfx_ppi_channel_disable(capture_ppi_stop);
+
+    /*
+     * The sample after the last written one is the oldest
+     */
+    oldest = nrf_saadc_amount_get() % CAPTURE_BUFFER_SIZE;
+
+    nrf_saadc_continuous_mode_disable();
+    nrf_saadc_disable();
+
+    (void)CAPTURE_TO_MV(capture_buffer, capture_buffer, CAPTURE_BUFFER_SIZE);
+
+    for (uint16_t i = 0; i < CAPTURE_BUFFER_SIZE; i++)
+    {
+        int16_t mv = capture_buffer[(oldest + i) % CAPTURE_BUFFER_SIZE];
+
+        if (i < CFG_CAPTURE_PRE_SAMPLES)
+        {
+            pre_min = MIN(pre_min, mv);
+            pre_max = MAX(pre_max, mv);
+        }
+        else
+        {
+            post_min = MIN(post_min, mv);
+            post_max = MAX(post_max, mv);
+        }
+    }
+
+    NRF_LOG_INFO("CAPTURE: done, oldest sample at %d", oldest);
+    NRF_LOG_INFO("CAPTURE: pre-trigger %d..%d mV, post-trigger %d..%d mV",
+            pre_min, pre_max, post_min, post_max);
+
+    /*
+     * Continuous acquisition is restarted after calibration
+     */
+    capture_active = false;
+    saadc_calib_temp_valid = false;
+    saadc_init();
+}
+
+/*
+ * @brief Function for disarming capture without probe edge, called from
+ * main loop.
+ */
+static void capture_timeout(void)
+{
+    if (!capture_active)
+    {
+        return;
+    }
+
+    /*
+     * Triggers are disabled first, so edge can not come after the check
+     */
+    vtimer_stop(&capture_fill_timer);
+    for (uint8_t i = 0; i < CAPTURE_TRIGGER_COUNT; i++)
+    {
+        (void)nrfx_ppi_channel_disable(capture_ppi_trigger[i]);
+    }
+
+    if (nrf_egu_event_check(CAPTURE_EDGE_EGU,
+            nrf_egu_event_triggered_get(CAPTURE_EDGE_EGU,
+                    CAPTURE_EDGE_EGU_CHANNEL)))
+    {
+        /*
+         * Edge came in time and started TIMER4, capture is completed by
+         * APP_EVT_CAPTURE
+         */
+        return;
+    }
+
+    NRF_LOG_WARNING("CAPTURE: no trigger in %d ms, disarmed",
+            CFG_CAPTURE_ARM_TIMEOUT_MS);
+
+    capture_abort();
+}
+
+static void capture_init(void)
+{
+    nrfx_err_t err_code;
+
+    nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG;
+    timer_config.mode = NRF_TIMER_MODE_COUNTER;
+    timer_config.bit_width = NRF_TIMER_BIT_WIDTH_16;
+    err_code = nrfx_timer_init(&timer4, &timer_config,
+            capture_timer_event_handler);
+    APP_ERROR_CHECK(err_code);
+
+    /*
+     * Counting starts with probe edge
+     */
+    nrfx_timer_extended_compare(&timer4, NRF_TIMER_CC_CHANNEL0,
+            CFG_CAPTURE_POST_SAMPLES,
+            NRF_TIMER_SHORT_COMPARE0_STOP_MASK |
+            NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, true);
+
+    err_code = nrfx_ppi_channel_alloc(&capture_ppi_count);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrfx_ppi_channel_assign(capture_ppi_count,
+            nrf_saadc_event_address_get(NRF_SAADC_EVENT_RESULTDONE),
+            nrfx_timer_task_address_get(&timer4, NRF_TIMER_TASK_COUNT));
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_ppi_channel_alloc(&capture_ppi_restart);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrfx_ppi_channel_assign(capture_ppi_restart,
+            nrf_saadc_event_address_get(NRF_SAADC_EVENT_END),
+            nrf_saadc_task_address_get(NRF_SAADC_TASK_START));
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_ppi_group_alloc(&capture_ppi_group);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrfx_ppi_channel_include_in_group(capture_ppi_restart,
+            capture_ppi_group);
+    APP_ERROR_CHECK(err_code);
+
+    for (uint8_t i = 0; i < CAPTURE_TRIGGER_COUNT; i++)
+    {
+        err_code = nrfx_ppi_channel_alloc(&capture_ppi_trigger[i]);
+        APP_ERROR_CHECK(err_code);
+        err_code = nrfx_ppi_channel_assign(capture_ppi_trigger[i],
+                nrfx_gpiote_in_event_addr_get(capture_trigger_pins[i]),
+                nrfx_timer_task_address_get(&timer4, NRF_TIMER_TASK_START));
+        APP_ERROR_CHECK(err_code);
+        err_code = nrfx_ppi_channel_fork_assign(capture_ppi_trigger[i],
+                nrf_egu_task_trigger_address_get(CAPTURE_EDGE_EGU,
+                        CAPTURE_EDGE_EGU_CHANNEL));
+        APP_ERROR_CHECK(err_code);
+        err_code = nrfx_ppi_channel_include_in_group(capture_ppi_trigger[i],
+                capture_ppi_group);
+        APP_ERROR_CHECK(err_code);
+    }
+
+    /*
+     * Stop sampling and disarm with one event
+     */
+    err_code = nrfx_ppi_channel_alloc(&capture_ppi_stop);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrfx_ppi_channel_assign(capture_ppi_stop,
+            nrfx_timer_compare_event_address_get(&timer4,
+                    NRF_TIMER_CC_CHANNEL0),
+            nrf_saadc_task_address_get(NRF_SAADC_TASK_STOP));
+    APP_ERROR_CHECK(err_code);
+    err_code = nrfx_ppi_channel_fork_assign(capture_ppi_stop,
+            nrfx_ppi_task_addr_group_disable_get(capture_ppi_group));
+    APP_ERROR_CHECK(err_code);
+}
+#endif
+
+/*
+ * TEMP conversion requesters, passed as APP_EVT_TEMP source: only periodic
+ * results go to statistics, time series and flash log, so on-demand ones
+ * do not add out of schedule records
+ */
+#define TEMP_REQUEST_PERIODIC (1u << 0)
+#define TEMP_REQUEST_JOB (1u << 1)
+
+static nrf_atomic_u32_t temp_requests;
+
+/*
+ * Starts TEMP measurement and returns, result comes with DATARDY interrupt
+ * as APP_EVT_TEMP and is processed by temp_measure_done(). Conversion in
+ * progress is shared by all requesters.
+ */
+void temp_measure_start(uint32_t request)
+{
+    nrfx_err_t err_code;
+
+    (void)nrf_atomic_u32_or(&temp_requests, request);
+
+    err_code = nrfx_temp_measure();
+    APP_ERROR_CHECK(err_code);
+}
+
+/*
+ * @brief Function for processing periodic measurement result.
+ *
+ * @param time  Scheduled time of the measurement.
+ */
+int32_t temp_measure_done(int32_t raw, timebase_t time)
+{
+    int32_t result = nrfx_temp_calculate(raw);
+
+    NRF_LOG_INFO("TEMP: temperature " NRF_LOG_FLOAT_MARKER " C", 
+            NRF_LOG_FLOAT((float)result / 100));
+#if CFG_STATS_ENABLED
+    stats_add(STATS_TEMP, (float)result / 100);
+#endif
+
+    saadc_temp_update(result);
+
+#if CFG_TSERIES_ENABLED
+    tseries_append(time, saadc_vdd_mv, result);
+#endif
+#if CFG_FLOG_ENABLED
+    flog_append(saadc_vdd_mv, result);
+#endif
+    return result;
+}
+
+/*
+ * LED engine: pattern is played back by PWM0 from RAM sequence buffer with
+ * EasyDMA, CPU is involved only at the start and, for long patterns, once
+ * per half of the buffer to copy the next chunk from flash.
+ *
+ * PWM period is 1 ms (125 kHz base clock, top 125), each pattern value is
+ * held for step_ms periods.
+ */
+const nrfx_pwm_t pwm0 = NRFX_PWM_INSTANCE(0);
+
+#define LED_PWM_TOP 125
+
+/*
+ * Shared RAM sequence buffer, EasyDMA can not read pattern tables from
+ * flash. Patterns longer than the buffer are streamed through its halves.
+ */
+#define LED_SEQ_BUFFER_SIZE 32
+#define LED_SEQ_HALF_SIZE (LED_SEQ_BUFFER_SIZE / 2)
+
+static nrf_pwm_values_common_t led_seq_buffer[LED_SEQ_BUFFER_SIZE];
+
+/*
+ * LED is active low: with rising edge polarity (bit 15 clear) output is
+ * low for compare value counts of the period, so value is LED brightness.
+ *
+ * Level is in percents of perceived brightness, squared to approximate
+ * eye response.
+ */
+#define LED_LEVEL(pct) \
+    ((nrf_pwm_values_common_t)((LED_PWM_TOP * (pct) * (pct) + 5000) / 10000))
+
+#define LED_ON LED_LEVEL(100)
+#define LED_OFF LED_LEVEL(0)
+
+/*
+ * Pattern: duty-cycle table in flash, step duration and gap after each
+ * playback. Gap is done by PWM end delay and is allowed only for patterns
+ * fitting the buffer.
+ */
+typedef struct
+{
+    nrf_pwm_values_common_t const * p_values;
+    uint16_t length;
+    uint16_t step_ms;
+    uint16_t gap_ms;
+} led_pattern_t;
+
+#define LED_PATTERN_DEF(name, step, gap, ...) \
+    static const nrf_pwm_values_common_t name##_values[] = { __VA_ARGS__ }; \
+    STATIC_ASSERT((gap) == 0 || \
+            ARRAY_SIZE(name##_values) <= LED_SEQ_BUFFER_SIZE); \
+    static const led_pattern_t name = \
+    { \
+        .p_values = name##_values, \
+        .length = ARRAY_SIZE(name##_values), \
+        .step_ms = (step), \
+        .gap_ms = (gap) \
+    }
+
+#define LED_REPEAT(n, ...) LED_REPEAT_##n(__VA_ARGS__)
+#define LED_REPEAT_1(...) __VA_ARGS__
+#define LED_REPEAT_2(...) __VA_ARGS__, LED_REPEAT_1(__VA_ARGS__)
+#define LED_REPEAT_3(...) __VA_ARGS__, LED_REPEAT_2(__VA_ARGS__)
+#define LED_REPEAT_4(...) __VA_ARGS__, LED_REPEAT_3(__VA_ARGS__)
+#define LED_REPEAT_5(...) __VA_ARGS__, LED_REPEAT_4(__VA_ARGS__)
+#define LED_REPEAT_6(...) __VA_ARGS__, LED_REPEAT_5(__VA_ARGS__)
+#define LED_REPEAT_7(...) __VA_ARGS__, LED_REPEAT_6(__VA_ARGS__)
+#define LED_REPEAT_8(...) __VA_ARGS__, LED_REPEAT_7(__VA_ARGS__)
+#define LED_REPEAT_9(...) __VA_ARGS__, LED_REPEAT_8(__VA_ARGS__)
+
+/*
+ * Breathing curve: 16 steps up and 16 steps down
+ */
+#define LED_RAMP16(f) \
+    f(0), f(1), f(2), f(3), f(4), f(5), f(6), f(7), \
+    f(8), f(9), f(10), f(11), f(12), f(13), f(14), f(15)
+
+#define LED_BREATHE_UP(i) LED_LEVEL((i) * 100 / 15)
+#define LED_BREATHE_DOWN(i) LED_LEVEL((15 - (i)) * 100 / 15)
+
+/*
+ * Error code: major pulses, pause, minor pulses, long pause
+ */
+#define LED_CODE_PULSE LED_ON, LED_OFF
+#define LED_CODE(major, minor) \
+    LED_REPEAT(major, LED_CODE_PULSE), LED_OFF, LED_OFF, \
+    LED_REPEAT(minor, LED_CODE_PULSE), LED_REPEAT(4, LED_OFF)
+
+/*
+ * Morse: one value per unit, dot is 1 unit, dash is 3 units, gap between
+ * elements is 1 unit, between characters 3 and between words 7 units
+ */
+#define LED_MORSE_UNIT_MS 120
+
+#define LED_DIT LED_ON, LED_OFF
+#define LED_DAH LED_ON, LED_ON, LED_ON, LED_OFF
+#define LED_MORSE_CHAR(...) __VA_ARGS__, LED_OFF, LED_OFF
+#define LED_MORSE_SPACE LED_REPEAT(4, LED_OFF)
+
+#define LED_MORSE_A LED_MORSE_CHAR(LED_DIT, LED_DAH)
+#define LED_MORSE_B LED_MORSE_CHAR(LED_DAH, LED_DIT, LED_DIT, LED_DIT)
+#define LED_MORSE_C LED_MORSE_CHAR(LED_DAH, LED_DIT, LED_DAH, LED_DIT)
+#define LED_MORSE_D LED_MORSE_CHAR(LED_DAH, LED_DIT, LED_DIT)
+#define LED_MORSE_E LED_MORSE_CHAR(LED_DIT)
+#define LED_MORSE_F LED_MORSE_CHAR(LED_DIT, LED_DIT, LED_DAH, LED_DIT)
+#define LED_MORSE_G LED_MORSE_CHAR(LED_DAH, LED_DAH, LED_DIT)
+#define LED_MORSE_H LED_MORSE_CHAR(LED_DIT, LED_DIT, LED_DIT, LED_DIT)
+#define LED_MORSE_I LED_MORSE_CHAR(LED_DIT, LED_DIT)
+#define LED_MORSE_J LED_MORSE_CHAR(LED_DIT, LED_DAH, LED_DAH, LED_DAH)
+#define LED_MORSE_K LED_MORSE_CHAR(LED_DAH, LED_DIT, LED_DAH)
+#define LED_MORSE_L LED_MORSE_CHAR(LED_DIT, LED_DAH, LED_DIT, LED_DIT)
+#define LED_MORSE_M LED_MORSE_CHAR(LED_DAH, LED_DAH)
+#define LED_MORSE_N LED_MORSE_CHAR(LED_DAH, LED_DIT)
+#define LED_MORSE_O LED_MORSE_CHAR(LED_DAH, LED_DAH, LED_DAH)
+#define LED_MORSE_P LED_MORSE_CHAR(LED_DIT, LED_DAH, LED_DAH, LED_DIT)
+#define LED_MORSE_Q LED_MORSE_CHAR(LED_DAH, LED_DAH, LED_DIT, LED_DAH)
+#define LED_MORSE_R LED_MORSE_CHAR(LED_DIT, LED_DAH, LED_DIT)
+#define LED_MORSE_S LED_MORSE_CHAR(LED_DIT, LED_DIT, LED_DIT)
+#define LED_MORSE_T LED_MORSE_CHAR(LED_DAH)
+#define LED_MORSE_U LED_MORSE_CHAR(LED_DIT, LED_DIT, LED_DAH)
+#define LED_MORSE_V LED_MORSE_CHAR(LED_DIT, LED_DIT, LED_DIT, LED_DAH)
+#define LED_MORSE_W LED_MORSE_CHAR(LED_DIT, LED_DAH, LED_DAH)
+#define LED_MORSE_X LED_MORSE_CHAR(LED_DAH, LED_DIT, LED_DIT, LED_DAH)
+#define LED_MORSE_Y LED_MORSE_CHAR(LED_DAH, LED_DIT, LED_DAH, LED_DAH)
+#define LED_MORSE_Z LED_MORSE_CHAR(LED_DAH, LED_DAH, LED_DIT, LED_DIT)
+
+#define LED_MORSE_0 LED_MORSE_CHAR(LED_REPEAT(5, LED_DAH))
+#define LED_MORSE_1 LED_MORSE_CHAR(LED_DIT, LED_REPEAT(4, LED_DAH))
+#define LED_MORSE_2 LED_MORSE_CHAR(LED_REPEAT(2, LED_DIT), LED_REPEAT(3, LED_DAH))
+#define LED_MORSE_3 LED_MORSE_CHAR(LED_REPEAT(3, LED_DIT), LED_REPEAT(2, LED_DAH))
+#define LED_MORSE_4 LED_MORSE_CHAR(LED_REPEAT(4, LED_DIT), LED_DAH)
+#define LED_MORSE_5 LED_MORSE_CHAR(LED_REPEAT(5, LED_DIT))
+#define LED_MORSE_6 LED_MORSE_CHAR(LED_DAH, LED_REPEAT(4, LED_DIT))
+#define LED_MORSE_7 LED_MORSE_CHAR(LED_REPEAT(2, LED_DAH), LED_REPEAT(3, LED_DIT))
+#define LED_MORSE_8 LED_MORSE_CHAR(LED_REPEAT(3, LED_DAH), LED_REPEAT(2, LED_DIT))
+#define LED_MORSE_9 LED_MORSE_CHAR(LED_REPEAT(4, LED_DAH), LED_DIT)
+
+/*
+ * Pattern library
+ */
+LED_PATTERN_DEF(led_pattern_blink, CFG_LED_FLASH_DUTY_DELAY_MS,
+        CFG_LED_FLASH_CYCLE_DELAY_MS - CFG_LED_FLASH_DUTY_DELAY_MS,
+        LED_ON);
+
+LED_PATTERN_DEF(led_pattern_breathe, 60, 0,
+        LED_RAMP16(LED_BREATHE_UP), LED_RAMP16(LED_BREATHE_DOWN));
+
+LED_PATTERN_DEF(led_pattern_heartbeat, 100, 600,
+        LED_ON, LED_OFF, LED_LEVEL(40), LED_OFF);
+
+LED_PATTERN_DEF(led_pattern_code_evt_dropped, 200, 0,
+        LED_CODE(2, 1));
+
+LED_PATTERN_DEF(led_pattern_hello, LED_MORSE_UNIT_MS, 0,
+        LED_MORSE_O, LED_MORSE_K, LED_MORSE_SPACE);
+
+/*
+ * Pattern playback, done when PWM is stopped
+ */
+static job_dma_t led_dma;
+
+/*
+ * Streaming state, changed by main loop (with PWM stopped) and PWM handler
+ */
+static struct
+{
+    led_pattern_t const * p_pattern;
+    uint16_t offset;
+    uint8_t loops;
+    uint8_t idle;
+} led_stream;
+
+/*
+ * Copy next chunk of the pattern to the buffer half, pad with LED_OFF
+ * after the last loop. Returns false if there was no pattern data left.
+ */
+static bool led_stream_fill(uint8_t half)
+{
+    nrf_pwm_values_common_t *p_dst = &led_seq_buffer[half * LED_SEQ_HALF_SIZE];
+    led_pattern_t const *p_pattern = led_stream.p_pattern;
+    uint16_t filled = 0;
+
+    while (filled < LED_SEQ_HALF_SIZE && led_stream.loops)
+    {
+        uint16_t chunk = MIN(LED_SEQ_HALF_SIZE - filled,
+                p_pattern->length - led_stream.offset);
+
+        memcpy(&p_dst[filled], &p_pattern->p_values[led_stream.offset],
+                chunk * sizeof(p_dst[0]));
+        filled += chunk;
+        led_stream.offset += chunk;
+
+        if (led_stream.offset == p_pattern->length)
+        {
+            led_stream.offset = 0;
+            led_stream.loops--;
+        }
+    }
+
+    for (uint16_t i = filled; i < LED_SEQ_HALF_SIZE; i++)
+    {
+        p_dst[i] = LED_OFF;
+    }
+
+    return (filled != 0);
+}
+
+/*
+ * PWM0 handler: refill finished half of the buffer while the other one is
+ * played, stop after the last half with pattern data
+ */
+static void led_pwm_event_handler(nrfx_pwm_evt_type_t event_type)
+{
+    uint8_t half;
+
+    switch (event_type)
+    {
+        case NRFX_PWM_EVT_END_SEQ0:
+            half = 0;
+            break;
+        case NRFX_PWM_EVT_END_SEQ1:
+            half = 1;
+            break;
+        case NRFX_PWM_EVT_STOPPED:
+            job_dma_done(&led_dma);
+            return;
+        default:
+            return;
+    }
+
+    if (!led_stream_fill(half) && led_stream.idle++)
+    {
+        /*
+         * Both halves are padding now
+         */
+        (void)nrfx_pwm_stop(&pwm0, false);
+    }
+}
+
+/*
+ * @brief Function for playing LED pattern count times, replacing current
+ * one. Must be called from main loop.
+ */
+void led_pattern_play(led_pattern_t const *p_pattern, uint8_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    /*
+     * Buffer must not be used by PWM or refilled by the handler while it
+     * is rewritten, waits at most one PWM period
+     */
+    (void)nrfx_pwm_stop(&pwm0, true);
+    job_dma_start(&led_dma);
+
+    if (p_pattern->length <= LED_SEQ_BUFFER_SIZE)
+    {
+        nrf_pwm_sequence_t const seq =
+        {
+            .values.p_common = led_seq_buffer,
+            .length = p_pattern->length,
+            .repeats = p_pattern->step_ms - 1,
+            .end_delay = p_pattern->gap_ms
+        };
+
+        memcpy(led_seq_buffer, p_pattern->p_values,
+                p_pattern->length * sizeof(led_seq_buffer[0]));
+
+        (void)nrfx_pwm_simple_playback(&pwm0, &seq, count,
+                NRFX_PWM_FLAG_STOP | NRFX_PWM_FLAG_NO_EVT_FINISHED);
+    }
+    else
+    {
+        nrf_pwm_sequence_t const seq0 =
+        {
+            .values.p_common = &led_seq_buffer[0],
+            .length = LED_SEQ_HALF_SIZE,
+            .repeats = p_pattern->step_ms - 1,
+            .end_delay = 0
+        };
+        nrf_pwm_sequence_t const seq1 =
+        {
+            .values.p_common = &led_seq_buffer[LED_SEQ_HALF_SIZE],
+            .length = LED_SEQ_HALF_SIZE,
+            .repeats = p_pattern->step_ms - 1,
+            .end_delay = 0
+        };
+
+        led_stream.p_pattern = p_pattern;
+        led_stream.offset = 0;
+        led_stream.loops = count;
+        led_stream.idle = 0;
+
+        (void)led_stream_fill(0);
+        (void)led_stream_fill(1);
+
+        (void)nrfx_pwm_complex_playback(&pwm0, &seq0, &seq1, 1,
+                NRFX_PWM_FLAG_LOOP | NRFX_PWM_FLAG_NO_EVT_FINISHED |
+                NRFX_PWM_FLAG_SIGNAL_END_SEQ0 |
+                NRFX_PWM_FLAG_SIGNAL_END_SEQ1);
+    }
+}
+
+void led_blink(uint8_t count)
+{
+    led_pattern_play(&led_pattern_blink, count);
+}
+
+/*
+ * @brief Function for initializing LED PWM engine.
+ */
+static void led_init(void)
+{
+    nrfx_err_t err_code;
+    nrfx_pwm_config_t const config =
+    {
+        .output_pins =
+        {
+            /*
+             * Inverted flag only sets idle pin level: LED off
+             */
+            OUT_LED_0 | NRFX_PWM_PIN_INVERTED,
+            NRFX_PWM_PIN_NOT_USED,
+            NRFX_PWM_PIN_NOT_USED,
+            NRFX_PWM_PIN_NOT_USED
+        },
+        .irq_priority = NRFX_PWM_DEFAULT_CONFIG_IRQ_PRIORITY,
+        .base_clock = NRF_PWM_CLK_125kHz,
+        .count_mode = NRF_PWM_MODE_UP,
+        .top_value = LED_PWM_TOP,
+        .load_mode = NRF_PWM_LOAD_COMMON,
+        .step_mode = NRF_PWM_STEP_AUTO
+    };
+
+    err_code = nrfx_pwm_init(&pwm0, &config, led_pwm_event_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+#if CFG_SOC_ENABLED
+/*
+ * Battery state of charge
+ *
+ * VDD is taken only in idle windows (LED is off), filtered by EWMA,
+ * corrected for temperature and mapped to percents by piecewise linear
+ * discharge table of configured chemistry. Reported value changes only
+ * by CFG_SOC_HYST_PCT or more.
+ */
+#define SOC_CHEMISTRY_CR2032 0
+#define SOC_CHEMISTRY_2XAA_ALKALINE 1
+#define SOC_CHEMISTRY_LI_SOCL2 2
+
+typedef struct
+{
+    uint16_t mv;
+    uint8_t pct;
+} soc_point_t;
+
+typedef struct
+{
+    soc_point_t const *p_points;    /* descending mV */
+    uint8_t count;
+    uint8_t temp_coeff;             /* mV of VDD drop per 10 C below 25 C */
+} soc_chemistry_t;
+
+static const soc_point_t soc_points_cr2032[] =
+{
+    { 3000, 100 }, { 2900, 80 }, { 2800, 60 }, { 2700, 40 },
+    { 2600, 30 }, { 2500, 20 }, { 2400, 10 }, { 2200, 5 },
+    { 2000, 0 },
+};
+
+static const soc_point_t soc_points_2xaa_alkaline[] =
+{
+    { 3200, 100 }, { 3000, 90 }, { 2800, 75 }, { 2600, 55 },
+    { 2500, 40 }, { 2400, 25 }, { 2300, 15 }, { 2200, 8 },
+    { 2000, 3 }, { 1800, 0 },
+};
+
+static const soc_point_t soc_points_li_socl2[] =
+{
+    { 3650, 100 }, { 3600, 90 }, { 3550, 70 }, { 3500, 50 },
+    { 3450, 30 }, { 3400, 15 }, { 3300, 8 }, { 3100, 3 },
+    { 3000, 0 },
+};
+
+static const soc_chemistry_t soc_chemistries[] =
+{
+    [SOC_CHEMISTRY_CR2032] =
+    {
+        soc_points_cr2032, ARRAY_SIZE(soc_points_cr2032), 15
+    },
+    [SOC_CHEMISTRY_2XAA_ALKALINE] =
+    {
+        soc_points_2xaa_alkaline, ARRAY_SIZE(soc_points_2xaa_alkaline), 30
+    },
+    [SOC_CHEMISTRY_LI_SOCL2] =
+    {
+        soc_points_li_socl2, ARRAY_SIZE(soc_points_li_socl2), 10
+    },
+};
+
+#define SOC_EWMA_SHIFT 4
+
+static int32_t soc_vdd_filtered;        /* mV << SOC_EWMA_SHIFT */
+static int32_t soc_temp = 2500;         /* 0.01 C */
+static uint8_t soc_pct;
+static bool soc_valid;
+
+static uint8_t soc_lookup(soc_chemistry_t const *p_chem, int32_t mv)
+{
+    soc_point_t const *p = p_chem->p_points;
+
+    if (mv >= p[0].mv)
+    {
+        return p[0].pct;
+    }
+
+    for (uint8_t i = 1; i < p_chem->count; i++)
+    {
+        if (mv >= p[i].mv)
+        {
+            return p[i].pct + (mv - p[i].mv) * (p[i - 1].pct - p[i].pct) /
+                    (p[i - 1].mv - p[i].mv);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * @brief Function for getting state of charge in percents.
+ */
+uint8_t soc_get(void)
+{
+    return soc_pct;
+}
+
+/*
+ * @brief Function for updating temperature, 0.01 C, from main loop.
+ */
+static void soc_temp_update(int32_t temp)
+{
+    soc_temp = temp;
+}
+
+/*
+ * @brief Function for adding VDD sample, mV, from main loop.
+ */
+static void soc_vdd_update(int32_t mv)
+{
+    soc_chemistry_t const *p_chem = &soc_chemistries[CFG_SOC_CHEMISTRY];
+    int32_t corrected;
+    uint8_t pct;
+
+    /*
+     * LED current drops VDD of small cells
+     */
+    if (!nrfx_pwm_is_stopped(&pwm0))
+    {
+        return;
+    }
+
+    if (!soc_valid)
+    {
+        soc_vdd_filtered = mv << SOC_EWMA_SHIFT;
+    }
+    else
+    {
+        soc_vdd_filtered += mv - (soc_vdd_filtered >> SOC_EWMA_SHIFT);
+    }
+
+    /*
+     * Cold cell shows lower voltage for the same charge
+     */
+    corrected = (soc_vdd_filtered >> SOC_EWMA_SHIFT) +
+            p_chem->temp_coeff * (2500 - soc_temp) / 1000;
+
+    pct = soc_lookup(p_chem, corrected);
+
+    if (!soc_valid || pct >= soc_pct + CFG_SOC_HYST_PCT ||
+            pct + CFG_SOC_HYST_PCT <= soc_pct)
+    {
+        soc_pct = pct;
+        soc_valid = true;
+
+        NRF_LOG_INFO("SOC: %d%%, VDD %d mV", soc_pct, corrected);
+    }
+}
+#endif
+
+
+/*
+ * Button gesture engine
+ *
+ * Each button is one row of buttons_config[] and one slot of buttons[].
+ * Edges and timeouts of all buttons are processed by the common transition
+ * table indexed by [state][input], so dispatch is O(1) per edge and adding
+ * a button does not need any new code.
+ *
+ * Every button owns virtual timer, its expiration is passed to
+ * the engine as BUTTON_INPUT_TIMEOUT.
+ */
+typedef enum
+{
+    BUTTON_STATE_IDLE,
+    BUTTON_STATE_DEBOUNCE,      /* first press, debounce interval */
+    BUTTON_STATE_PRESSED,       /* first press, wait release or long press */
+    BUTTON_STATE_CLICK_WAIT,    /* released, wait for second click */
+    BUTTON_STATE_DEBOUNCE2,     /* second press, debounce interval */
+    BUTTON_STATE_PRESSED2,      /* second press, wait release or long press */
+    BUTTON_STATE_HELD,          /* long press, repeat while held */
+    BUTTON_STATE_COUNT
+} button_state_t;
+
+/*
+ * Input values are chosen so that input = (pin level ^ active level)
+ */
+typedef enum
+{
+    BUTTON_INPUT_PRESS,
+    BUTTON_INPUT_RELEASE,
+    BUTTON_INPUT_TIMEOUT,
+    BUTTON_INPUT_COUNT
+} button_input_t;
+
+typedef enum
+{
+    BUTTON_GESTURE_NONE,
+    BUTTON_GESTURE_SHORT,
+    BUTTON_GESTURE_LONG,
+    BUTTON_GESTURE_DOUBLE,
+    BUTTON_GESTURE_REPEAT
+} button_gesture_t;
+
+typedef enum
+{
+    BUTTON_DELAY_KEEP,          /* keep current deadline */
+    BUTTON_DELAY_NONE,          /* cancel deadline */
+    BUTTON_DELAY_DEBOUNCE,
+    BUTTON_DELAY_LONG,
+    BUTTON_DELAY_DOUBLE_CLICK,
+    BUTTON_DELAY_REPEAT,
+    BUTTON_DELAY_COUNT
+} button_delay_t;
+
+typedef struct
+{
+    uint8_t next;               /* button_state_t */
+    uint8_t gesture;            /* button_gesture_t */
+    uint8_t delay;              /* button_delay_t */
+} button_transition_t;
+
+typedef struct
+{
+    nrfx_gpiote_pin_t pin;
+    nrf_gpio_pin_pull_t pull;
+    uint8_t active_level;
+} button_config_t;
+
+typedef struct
+{
+    vtimer_t timer;
+    uint8_t state;              /* button_state_t */
+    uint8_t level;              /* last debounced pin level */
+} button_t;
+
+#define BUTTON_INDEX_NONE 0xFF
+
+static const button_config_t buttons_config[] =
+{
+    { IN_BUTTON_0, NRF_GPIO_PIN_PULLUP, 0 },
+};
+
+#define BUTTON_COUNT ARRAY_SIZE(buttons_config)
+
+STATIC_ASSERT(BUTTON_COUNT < BUTTON_INDEX_NONE);
+
+/*
+ * With hardware debounce edges are already stable, so debounce state
+ * of gesture engine only waits for minimal compare delay
+ */
+#if CFG_BUTTON_DEBOUNCE_HW
+#define BUTTON_SW_DEBOUNCE_DELAY RTC_CC_MIN_DELTA
+#else
+#define BUTTON_SW_DEBOUNCE_DELAY \
+            TIMEBASE_MS_TO_TICKS(CFG_BUTTON_DEBOUNCE_DELAY_MS)
+#endif
+
+static const uint32_t button_delays[BUTTON_DELAY_COUNT] =
+{
+    [BUTTON_DELAY_KEEP] = 0,
+    [BUTTON_DELAY_NONE] = 0,
+    [BUTTON_DELAY_DEBOUNCE] = BUTTON_SW_DEBOUNCE_DELAY,
+    [BUTTON_DELAY_LONG] =
+            TIMEBASE_MS_TO_TICKS(CFG_BUTTON_LONG_PRESS_DELAY_MS) -
+            BUTTON_SW_DEBOUNCE_DELAY,
+    [BUTTON_DELAY_DOUBLE_CLICK] =
+            TIMEBASE_MS_TO_TICKS(CFG_BUTTON_DOUBLE_CLICK_DELAY_MS),
+    [BUTTON_DELAY_REPEAT] =
+            TIMEBASE_MS_TO_TICKS(CFG_BUTTON_REPEAT_DELAY_MS),
+};
+
+#define BUTTON_TR(_next, _gesture, _delay) \
+    { BUTTON_STATE_##_next, BUTTON_GESTURE_##_gesture, BUTTON_DELAY_##_delay }
+
+static const button_transition_t
+        button_transitions[BUTTON_STATE_COUNT][BUTTON_INPUT_COUNT] =
+{
+    [BUTTON_STATE_IDLE] =
+    {
+        [BUTTON_INPUT_PRESS] = BUTTON_TR(DEBOUNCE, NONE, DEBOUNCE),
+        [BUTTON_INPUT_RELEASE] = BUTTON_TR(IDLE, NONE, NONE),
+        [BUTTON_INPUT_TIMEOUT] = BUTTON_TR(IDLE, NONE, NONE),
+    },
+    [BUTTON_STATE_DEBOUNCE] =
+    {
+        [BUTTON_INPUT_PRESS] = BUTTON_TR(DEBOUNCE, NONE, KEEP),
+        [BUTTON_INPUT_RELEASE] = BUTTON_TR(IDLE, NONE, NONE),
+        [BUTTON_INPUT_TIMEOUT] = BUTTON_TR(PRESSED, NONE, LONG),
+    },
+    [BUTTON_STATE_PRESSED] =
+    {
+        [BUTTON_INPUT_PRESS] = BUTTON_TR(PRESSED, NONE, KEEP),
+        [BUTTON_INPUT_RELEASE] = BUTTON_TR(CLICK_WAIT, NONE, DOUBLE_CLICK),
+        [BUTTON_INPUT_TIMEOUT] = BUTTON_TR(HELD, LONG, REPEAT),
+    },
+    [BUTTON_STATE_CLICK_WAIT] =
+    {
+        [BUTTON_INPUT_PRESS] = BUTTON_TR(DEBOUNCE2, NONE, DEBOUNCE),
+        [BUTTON_INPUT_RELEASE] = BUTTON_TR(CLICK_WAIT, NONE, KEEP),
+        [BUTTON_INPUT_TIMEOUT] = BUTTON_TR(IDLE, SHORT, NONE),
+    },
+    [BUTTON_STATE_DEBOUNCE2] =
+    {
+        [BUTTON_INPUT_PRESS] = BUTTON_TR(DEBOUNCE2, NONE, KEEP),
+        [BUTTON_INPUT_RELEASE] = BUTTON_TR(IDLE, SHORT, NONE),
+        [BUTTON_INPUT_TIMEOUT] = BUTTON_TR(PRESSED2, NONE, LONG),
+    },
+    [BUTTON_STATE_PRESSED2] =
+    {
+        [BUTTON_INPUT_PRESS] = BUTTON_TR(PRESSED2, NONE, KEEP),
+        [BUTTON_INPUT_RELEASE] = BUTTON_TR(IDLE, DOUBLE, NONE),
+        [BUTTON_INPUT_TIMEOUT] = BUTTON_TR(HELD, LONG, REPEAT),
+    },
+    [BUTTON_STATE_HELD] =
+    {
+        [BUTTON_INPUT_PRESS] = BUTTON_TR(HELD, NONE, KEEP),
+        [BUTTON_INPUT_RELEASE] = BUTTON_TR(IDLE, NONE, NONE),
+        [BUTTON_INPUT_TIMEOUT] = BUTTON_TR(HELD, REPEAT, REPEAT),
+    },
+};
+
+static button_t buttons[BUTTON_COUNT];
+
+/*
+ * Pin number to button index map
+ */
+static uint8_t button_index[NUMBER_OF_PINS];
+
+/*
+ * Short press job: measure VDD and temperature when LED blink is done,
+ * so PWM load does not disturb VDD
+ */
+static PT_THREAD(measure_job_thread(job_t *p_job))
+{
+    PT_BEGIN(&p_job->pt);
+
+    JOB_WAIT_DMA(p_job, &led_dma);
+
+#if !CFG_SAADC_CONTINUOUS
+#if CFG_CAPTURE_ENABLED
+    if (!capture_active)
+#endif
+    {
+        saadc_sample();
+    }
+#endif
+
+    temp_measure_start(TEMP_REQUEST_JOB);
+    do
+    {
+        JOB_WAIT_EVT(p_job, APP_EVT_TEMP);
+    } while (!(p_job->evt.source & TEMP_REQUEST_JOB));
+
+    NRF_LOG_INFO("JOB: VDD %d mV, temperature " NRF_LOG_FLOAT_MARKER " C",
+            saadc_vdd_mv, NRF_LOG_FLOAT(
+                (float)nrfx_temp_calculate((int16_t)p_job->evt.value) / 100));
+
+    PT_END(&p_job->pt);
+}
+
+JOB_DEF(measure_job, measure_job_thread);
+
+/*
+ * Long press job: dump statistics and logs with pauses, so log is
+ * flushed between dumps
+ */
+static PT_THREAD(report_job_thread(job_t *p_job))
+{
+#if CFG_TSERIES_ENABLED
+    static tseries_iter_t tseries_iter;
+#endif
+#if CFG_FLOG_ENABLED
+    static flog_iter_t flog_iter;
+#endif
+
+    PT_BEGIN(&p_job->pt);
+
+#if CFG_IRQ_SELFTEST_ENABLED
+    irq_selftest_begin();
+    while (irq_selftest_step())
+    {
+        JOB_WAIT_MS(p_job, IRQ_SELFTEST_RUN_MS);
+    }
+    if (irq_selftest_end())
+    {
+        NRF_LOG_WARNING("IRQ: priority tiers self-test failed");
+    }
+    JOB_WAIT_MS(p_job, CFG_JOB_REPORT_PAUSE_MS);
+#endif
+
+#if CFG_ISR_STATS_ENABLED
+    isr_stats_dump();
+    JOB_WAIT_MS(p_job, CFG_JOB_REPORT_PAUSE_MS);
+#endif
+    sched_stats_dump();
+#if CFG_TSERIES_ENABLED
+    JOB_WAIT_MS(p_job, CFG_JOB_REPORT_PAUSE_MS);
+
+    /*
+     * One block per run, event and log processing go on between blocks
+     */
+    tseries_iter_init(&tseries_iter);
+    while (tseries_dump_step(&tseries_iter))
+    {
+        JOB_WAIT_MS(p_job, TSERIES_DUMP_PAUSE_MS);
+    }
+#endif
+#if CFG_FLOG_ENABLED
+    JOB_WAIT_MS(p_job, CFG_JOB_REPORT_PAUSE_MS);
+
+    flog_iter_init(&flog_iter);
+    while (flog_dump_step(&flog_iter))
+    {
+        JOB_WAIT_MS(p_job, FLOG_DUMP_PAUSE_MS);
+    }
+#endif
+
+    PT_END(&p_job->pt);
+}
+
+JOB_DEF(report_job, report_job_thread);
+
+/*
+ * Called from main loop for APP_EVT_BUTTON
+ */
+static void button_gesture_handler(uint8_t index, button_gesture_t gesture)
+{
+    NRF_LOG_INFO("BUTTON: %d gesture %d", index, gesture);
+
+    switch (gesture)
+    {
+        case BUTTON_GESTURE_SHORT:
+            led_blink(2);
+#if CFG_CAPTURE_ENABLED
+            capture_arm();
+#endif
+            (void)job_start(&measure_job);
+            break;
+        case BUTTON_GESTURE_DOUBLE:
+            led_pattern_play(&led_pattern_breathe, 1);
+#if CFG_ISR_STATS_ENABLED
+            isr_stats_reset();
+#endif
+            break;
+        case BUTTON_GESTURE_LONG:
+            led_blink(5);
+            (void)job_start(&report_job);
+            break;
+        case BUTTON_GESTURE_REPEAT:
+            led_blink(1);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Called from input handler for edges and from RTC1 handler for timeouts,
+ * which is preempted by input tier, so transition is a critical section
+ */
+static void button_process(uint8_t index, button_input_t input)
+{
+    button_t *p_button = &buttons[index];
+    button_transition_t const *p_transition;
+
+    /*
+     * Critical section macros open a block: enter and exit stay in one scope
+     */
+    NRFX_CRITICAL_SECTION_ENTER();
+
+    /*
+     * Timer restarted by an edge after expiry: timeout is stale
+     */
+    if (!(input == BUTTON_INPUT_TIMEOUT &&
+            vtimer_is_running(&p_button->timer)))
+    {
+        p_transition = &button_transitions[p_button->state][input];
+        p_button->state = p_transition->next;
+
+        if (p_transition->delay == BUTTON_DELAY_NONE)
+        {
+            vtimer_stop(&p_button->timer);
+        }
+        else if (p_transition->delay != BUTTON_DELAY_KEEP)
+        {
+            vtimer_start(&p_button->timer,
+                    button_delays[p_transition->delay], 0);
+        }
+
+        if (p_transition->gesture != BUTTON_GESTURE_NONE)
+        {
+            app_evt_put(APP_EVT_BUTTON, index, p_transition->gesture);
+        }
+    }
+
+    NRFX_CRITICAL_SECTION_EXIT();
+}
+
+static void button_timer_handler(void *p_context)
+{
+    button_process((button_t *)p_context - buttons, BUTTON_INPUT_TIMEOUT);
+}
+
+#if !CFG_BUTTON_DEBOUNCE_HW || INPUT_MONITOR_USED
+static void input_edge_process(nrfx_gpiote_pin_t pin, uint8_t level)
+{
+    uint8_t index = button_index[pin];
+
+    app_evt_put(APP_EVT_GPIO, pin, level);
+
+    if (index != BUTTON_INDEX_NONE)
+    {
+        button_process(index, (button_input_t)
+                (level ^ buttons_config[index].active_level));
+    }
+}
+#endif
+
+#if !CFG_BUTTON_DEBOUNCE_HW && !INPUT_MONITOR_USED
+static void gpio_event_handler(nrfx_gpiote_pin_t pin,
+        nrf_gpiote_polarity_t action)
+{
+    ISR_STATS_ENTER(ISR_STATS_INPUT);
+
+    input_edge_process(pin, nrfx_gpiote_in_is_set(pin));
+
+    ISR_STATS_EXIT(ISR_STATS_INPUT);
+}
+#endif
+
+#if INPUT_MONITOR_USED
+/*
+ * Input monitor
+ *
+ * All monitored pins have SENSE set to level opposite to the last
+ * snapshot and port DETECT signal is taken from LATCH. So any change
+ * raises single PORT event, no matter how many pins changed, and the
+ * handler only reads IN once per port and touches changed pins.
+ */
+typedef struct
+{
+    NRF_GPIO_Type *p_reg;
+    uint32_t mask;
+    uint32_t snapshot;
+} input_monitor_port_t;
+
+static input_monitor_port_t input_monitor_ports[GPIO_COUNT] =
+{
+    { NRF_P0, CFG_INPUT_MONITOR_PINS_P0, 0 },
+#if GPIO_COUNT > 1
+    { NRF_P1, CFG_INPUT_MONITOR_PINS_P1, 0 },
+#endif
+};
+
+void SWI3_EGU3_IRQHandler(void)
+{
+#if !CFG_BUTTON_DEBOUNCE_HW
+    /*
+     * With hardware debounce input statistics are taken by TIMER0
+     * handler
+     */
+    ISR_STATS_ENTER(ISR_STATS_INPUT);
+#endif
+
+    nrf_egu_event_clear(NRF_EGU3, NRF_EGU_EVENT_TRIGGERED0);
+    nrf_gpiote_event_clear(NRF_GPIOTE_EVENTS_PORT);
+
+    for (uint8_t port = 0; port < GPIO_COUNT; port++)
+    {
+        input_monitor_port_t *p_port = &input_monitor_ports[port];
+
+        do
+        {
+            uint32_t in = p_port->p_reg->IN;
+            uint32_t changed = (in ^ p_port->snapshot) & p_port->mask;
+
+            p_port->snapshot ^= changed;
+
+            while (changed)
+            {
+                uint32_t bit = __CLZ(__RBIT(changed));
+                uint8_t level = (in >> bit) & 1;
+                nrfx_gpiote_pin_t pin = NRF_GPIO_PIN_MAP(port, bit);
+
+                changed &= changed - 1;
+
+                nrf_gpio_cfg_sense_set(pin, level?
+                        NRF_GPIO_PIN_SENSE_LOW: NRF_GPIO_PIN_SENSE_HIGH);
+                input_edge_process(pin, level);
+            }
+
+            /*
+             * Pins still matching SENSE are latched again and
+             * processed by next pass
+             */
+            p_port->p_reg->LATCH = p_port->mask;
+        } while (p_port->p_reg->LATCH & p_port->mask);
+    }
+
+#if !CFG_BUTTON_DEBOUNCE_HW
+    ISR_STATS_EXIT(ISR_STATS_INPUT);
+#endif
+}
+#endif
+
+#if CFG_BUTTON_DEBOUNCE_HW
+/*
+ * TIMER0 COMPARE0: debounce interval is expired with no edges,
+ * pass changed levels of all buttons to gesture engine
+ */
+static void timer0_event_handler(nrf_timer_event_t event_type,
+        void *p_context)
+{
+    if (event_type != NRF_TIMER_EVENT_COMPARE0)
+    {
+        return;
+    }
+
+    ISR_STATS_ENTER(ISR_STATS_INPUT);
+
+    for (uint8_t i = 0; i < BUTTON_COUNT; i++)
+    {
+        uint8_t level = nrf_gpio_pin_read(buttons_config[i].pin);
+
+        if (level != buttons[i].level)
+        {
+            app_evt_put(APP_EVT_GPIO, buttons_config[i].pin, level);
+
+            buttons[i].level = level;
+            button_process(i, (button_input_t)
+                    (level ^ buttons_config[i].active_level));
+        }
+    }
+
+    ISR_STATS_EXIT(ISR_STATS_INPUT);
+}
+#endif
+
+#if CFG_PROBE_COUNTER_MODE
+/*
+ * Probe pulse counters
+ *
+ * TIMER instance of each probe is in low power counter mode, so
+ * counting is done by hardware at any pulse rate GPIOTE can follow.
+ * Periodic virtual timer captures counters and calculates pulse rates.
+ */
+typedef struct
+{
+    nrfx_gpiote_pin_t pin;
+    nrfx_timer_t timer;
+} probe_config_t;
+
+static const probe_config_t probes_config[] =
+{
+    { IN_PROBE_1, NRFX_TIMER_INSTANCE(1) },
+    { IN_PROBE_2, NRFX_TIMER_INSTANCE(2) },
+};
+
+#define PROBE_COUNT ARRAY_SIZE(probes_config)
+
+#define PROBE_RATE_PERIOD TIMEBASE_MS_TO_TICKS(CFG_PROBE_RATE_PERIOD_MS)
+
+/*
+ * Counter values captured at last period and pulse rates in Hz
+ */
+static uint32_t probe_counts[PROBE_COUNT];
+static uint32_t probe_rates[PROBE_COUNT];
+
+/*
+ * Counters do not generate interrupts, handler is required by driver
+ */
+static void probe_timer_event_handler(nrf_timer_event_t event_type,
+        void *p_context)
+{
+}
+
+/*
+ * Probe timer handler: capture counters and calculate pulse rates, main
+ * loop is woken up only when a rate is changed
+ */
+static void probe_rate_handler(void *p_context)
+{
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
+    {
+        uint32_t count = nrfx_timer_capture(&probes_config[i].timer,
+                NRF_TIMER_CC_CHANNEL0);
+        uint32_t rate = (uint32_t)((uint64_t)(count - probe_counts[i]) *
+                1000 / CFG_PROBE_RATE_PERIOD_MS);
+
+        probe_counts[i] = count;
+        if (rate != probe_rates[i])
+        {
+            probe_rates[i] = rate;
+            app_evt_put(APP_EVT_PROBE_RATE, i, 0);
+        }
+    }
+}
+
+static vtimer_t probe_timer = VTIMER_INIT(probe_rate_handler, NULL);
+#else
+static void probe_event_handler(nrfx_gpiote_pin_t pin,
+        nrf_gpiote_polarity_t action)
+{
+    app_evt_put(APP_EVT_PROBE, pin, 0);
+}
+#endif
+
+static void saadc_event_handler(nrfx_saadc_evt_t const *p_event)
+{
+#if CFG_SAADC_CONTINUOUS
+    switch (p_event->type)
+    {
+        case NRFX_SAADC_EVT_DONE:
+            app_evt_put(APP_EVT_SAADC,
+                    (p_event->data.done.p_buffer == saadc_buffers[0])? 0: 1,
+                    p_event->data.done.size);
+            break;
+        case NRFX_SAADC_EVT_CALIBRATEDONE:
+            saadc_acquisition_start();
+            break;
+#if CFG_VDD_ALARM_ENABLED
+        case NRFX_SAADC_EVT_LIMIT:
+            vdd_alarm_disarm();
+            app_evt_put(APP_EVT_VDD_ALARM, p_event->data.limit.channel,
+                    p_event->data.limit.limit_type);
+            break;
+#endif
+        default:
+            break;
+    }
+#endif
+}
+
+#if CFG_SAADC_CONTINUOUS
+static void rtc2_event_handler(nrfx_rtc_int_type_t event) {}
+#endif
+
+static void temp_event_handler(int32_t value)
+{
+    /*
+     * Raw value is in 0.25 C units, fits to 16 bits
+     */
+    app_evt_put(APP_EVT_TEMP,
+            (uint8_t)nrf_atomic_u32_fetch_store(&temp_requests, 0),
+            (uint16_t)value);
+}
+
+void clock_event_handler(nrfx_clock_evt_type_t event) {}
+
+/*
+ * RTC0 periodic ticks
+ *
+ * Every tick owns one RTC0 compare channel and is locked to RTC0 counter:
+ * on match compare value is advanced by period (CC += N modulo 24 bits)
+ * and counter keeps running, so time between match and handling is not
+ * lost and error does not accumulate. Ticks with different phase share
+ * the same counter. RTC0 runs without prescaler as timebase does, so
+ * periods are exact in LFCLK ticks.
+ */
+typedef enum
+{
+    RTC0_TICK_MAIN_LOOP,
+    RTC0_TICK_COUNT
+} rtc0_tick_id_t;
+
+STATIC_ASSERT(RTC0_TICK_COUNT <= RTC0_CC_NUM);
+
+typedef struct
+{
+    void (*handler)(void);
+    uint32_t period;            /* RTC0 ticks, less than half range */
+    uint32_t phase;             /* RTC0 counter of the first tick */
+    uint32_t next;              /* Current compare value */
+    uint32_t skipped;           /* Ticks lost due to late handling */
+    timebase_t deadline;        /* Timebase at current compare value */
+    timebase_t time;            /* Timebase of the last handled tick */
+} rtc0_tick_t;
+
+static void main_loop_tick(void)
+{
+    app_evt_put(APP_EVT_MAIN_LOOP, 0, 0);
+}
+
+static rtc0_tick_t rtc0_ticks[RTC0_TICK_COUNT] =
+{
+    [RTC0_TICK_MAIN_LOOP] =
+    {
+        .handler = main_loop_tick,
+        .period = TIMEBASE_MS_TO_TICKS(CFG_MAIN_LOOP_DELAY_MS),
+        .phase = TIMEBASE_MS_TO_TICKS(CFG_MAIN_LOOP_PHASE_MS),
+    },
+};
+
+STATIC_ASSERT(TIMEBASE_MS_TO_TICKS(CFG_MAIN_LOOP_DELAY_MS) <
+        RTC_COUNTER_HALF_RANGE);
+
+/*
+ * @brief Function for setting compare channel to the next tick.
+ *
+ * Ticks already passed or too close to be set are skipped in whole
+ * periods, so phase is kept.
+ *
+ * @return Number of skipped ticks.
+ */
+static uint32_t rtc0_tick_arm(rtc0_tick_id_t id)
+{
+    nrfx_err_t err_code;
+    rtc0_tick_t *p_tick = &rtc0_ticks[id];
+    uint32_t counter = nrfx_rtc_counter_get(&rtc0);
+    uint32_t skipped = 0;
+
+    while (true)
+    {
+        while ((RTC_COUNTER_DIFF(p_tick->next, counter) < RTC_CC_MIN_DELTA) ||
+                (RTC_COUNTER_DIFF(p_tick->next, counter) >=
+                    RTC_COUNTER_HALF_RANGE))
+        {
+            p_tick->next = (p_tick->next + p_tick->period) &
+                    RTC_COUNTER_MASK;
+            p_tick->deadline += p_tick->period;
+            skipped++;
+        }
+
+        err_code = nrfx_rtc_cc_set(&rtc0, id, p_tick->next, true);
+        APP_ERROR_CHECK(err_code);
+
+        /*
+         * Counter may have reached compare value while it was set: event
+         * cleared by the next write, so tick is skipped
+         */
+        counter = nrfx_rtc_counter_get(&rtc0);
+        if (!RTC_CC_TOO_CLOSE(p_tick->next, counter))
+        {
+            break;
+        }
+    }
+
+    return skipped;
+}
+
+static void rtc0_tick_start(rtc0_tick_id_t id)
+{
+    rtc0_tick_t *p_tick = &rtc0_ticks[id];
+
+    /*
+     * RTC0 and timebase count the same LFCLK, so deadlines are mapped to
+     * timebase once and then advanced by periods
+     */
+    p_tick->next = p_tick->phase & RTC_COUNTER_MASK;
+    p_tick->deadline = timebase_now() +
+            RTC_COUNTER_DIFF(p_tick->next, nrfx_rtc_counter_get(&rtc0));
+    rtc0_tick_arm(id);
+}
+
+/*
+ * @brief Function for getting scheduled time of the last handled tick,
+ * called from main loop.
+ */
+static timebase_t rtc0_tick_time(rtc0_tick_id_t id)
+{
+    timebase_t time;
+
+    NRFX_CRITICAL_SECTION_ENTER();
+    time = rtc0_ticks[id].time;
+    NRFX_CRITICAL_SECTION_EXIT();
+
+    return time;
+}
+
+/*
+ * @brief Function for processing tick, called from RTC0 handler.
+ */
+static void rtc0_tick_process(rtc0_tick_id_t id)
+{
+    rtc0_tick_t *p_tick = &rtc0_ticks[id];
+
+    p_tick->time = p_tick->deadline;
+    p_tick->next = (p_tick->next + p_tick->period) & RTC_COUNTER_MASK;
+    p_tick->deadline += p_tick->period;
+    p_tick->skipped += rtc0_tick_arm(id);
+
+    p_tick->handler();
+}
+
+void rtc0_event_handler(nrfx_rtc_int_type_t event)
+{
+    ISR_STATS_ENTER(ISR_STATS_RTC0);
+
+    switch (event)
+    {
+        /*
+         * Periodic ticks, channel per tick
+         */
+        case NRFX_RTC_INT_COMPARE0:
+        case NRFX_RTC_INT_COMPARE1:
+        case NRFX_RTC_INT_COMPARE2:
+            if (event - NRFX_RTC_INT_COMPARE0 < RTC0_TICK_COUNT)
+            {
+                rtc0_tick_process(
+                        (rtc0_tick_id_t)(event - NRFX_RTC_INT_COMPARE0));
+            }
+            break;
+        default:
+            break;
+    }
+
+    ISR_STATS_EXIT(ISR_STATS_RTC0);
+}
+
+
+void rtc1_event_handler(nrfx_rtc_int_type_t event)
+{
+    switch (event)
+    {
+        /*
+         * Nearest virtual timer deadline reached, statistics are taken
+         * here only: latency source is COMPARE0 event
+         */
+        case NRFX_RTC_INT_COMPARE0:
+        {
+            ISR_STATS_ENTER(ISR_STATS_RTC1);
+            vtimer_process();
+            ISR_STATS_EXIT(ISR_STATS_RTC1);
+            break;
+        }
+        /*
+         * Timebase half period boundaries
+         */
+        case NRFX_RTC_INT_COMPARE1:
+        case NRFX_RTC_INT_OVERFLOW:
+            timebase_half_period();
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * @brief Function for processing events queued by interrupt handlers.
+ *
+ * Drains whole queue in one batch, runs as scheduler task.
+ */
+static void app_evt_process(void)
+{
+    app_evt_t evt;
+    uint32_t dropped;
+
+    while (nrf_atfifo_get_free(app_evt_fifo, &evt, sizeof(evt), NULL) ==
+            NRF_SUCCESS)
+    {
+        switch (evt.type)
+        {
+            case APP_EVT_GPIO:
+                NRF_LOG_INFO("GPIO: pin %d is %s", evt.source,
+                        (evt.value? "set": "clear"));
+                break;
+            case APP_EVT_BUTTON:
+                button_gesture_handler(evt.source,
+                        (button_gesture_t)evt.value);
+                break;
+            case APP_EVT_PROBE:
+                NRF_LOG_INFO("GPIO: probe pin %d", evt.source);
+                led_blink(10);
+                break;
+#if CFG_PROBE_COUNTER_MODE
+            case APP_EVT_PROBE_RATE:
+                NRF_LOG_INFO("PROBE: pin %d rate %u Hz",
+                        probes_config[evt.source].pin,
+                        probe_rates[evt.source]);
+                break;
+#endif
+            case APP_EVT_MAIN_LOOP:
+                /*
+                 * Heartbeat does not cut off pattern still playing (error
+                 * code, morse), it is skipped instead
+                 */
+                if (!led_dma.busy)
+                {
+                    led_pattern_play(&led_pattern_heartbeat, 1);
+                }
+
+                /*
+                 * TEMP conversion runs in background while SAADC is
+                 * sampled
+                 */
+                temp_measure_start(TEMP_REQUEST_PERIODIC);
+
+#if CFG_SAADC_CONTINUOUS
+                NRF_LOG_INFO("SAADC: VDD value %d mV",
+                        saadc_means[SAADC_CH_VDD]);
+                for (uint8_t ch = SAADC_CH_VDD + 1; ch < SAADC_CHANNEL_COUNT;
+                        ch++)
+                {
+                    NRF_LOG_INFO("SAADC: channel %d mean %d mV", ch,
+                            saadc_means[ch]);
+                }
+#elif CFG_CAPTURE_ENABLED
+                if (!capture_active)
+                {
+                    saadc_sample();
+                }
+#else
+                saadc_sample();
+#endif
+#if CFG_SOC_ENABLED && !CFG_SAADC_CONTINUOUS
+                soc_vdd_update(saadc_vdd_mv);
+#endif
+                break;
+            case APP_EVT_TEMP:
+                if (!(evt.source & TEMP_REQUEST_PERIODIC))
+                {
+                    break;
+                }
+#if CFG_SOC_ENABLED
+                soc_temp_update(temp_measure_done((int16_t)evt.value,
+                        rtc0_tick_time(RTC0_TICK_MAIN_LOOP)));
+#else
+                temp_measure_done((int16_t)evt.value,
+                        rtc0_tick_time(RTC0_TICK_MAIN_LOOP));
+#endif
+                break;
+#if CFG_CAPTURE_ENABLED
+            case APP_EVT_CAPTURE:
+                if (evt.source == CAPTURE_EVT_TIMEOUT)
+                {
+                    capture_timeout();
+                }
+                else
+                {
+                    capture_done();
+                }
+                break;
+#endif
+#if CFG_VDD_ALARM_ENABLED
+            case APP_EVT_VDD_ALARM:
+                vdd_alarm_process((nrf_saadc_limit_t)evt.value);
+                break;
+#endif
+#if CFG_SAADC_CONTINUOUS
+            case APP_EVT_SAADC:
+                saadc_buffer_process(evt.source);
+#if CFG_SOC_ENABLED
+                soc_vdd_update(saadc_vdd_mv);
+#endif
+                break;
+#endif
+            default:
+                break;
+        }
+
+        job_evt_signal(&evt);
+    }
+
+    dropped = nrf_atomic_u32_fetch_store(&app_evt_dropped, 0);
+    if (dropped)
+    {
+        NRF_LOG_WARNING("EVT: %d events dropped", dropped);
+        led_pattern_play(&led_pattern_code_evt_dropped, 1);
+    }
+}
+
+SCHED_TASK_DEF(app_evt_task, app_evt_process, SCHED_PRIO_HIGH, 20);
+
+/*
+ * @brief Function for scheduling event processing, called after each
+ * event put.
+ */
+static void app_evt_notify(void)
+{
+    sched_post(&app_evt_task);
+}
+
+/*
+ * @brief Function for initializing the button handler module.
+ */
+static void gpio_init(void)
+{
+    nrfx_err_t err_code;
+
+    if (!nrfx_gpiote_is_init())
+    {
+        err_code = nrfx_gpiote_init();
+        APP_ERROR_CHECK(err_code);
+    }
+
     /**
-     * RTC1 CC Channel 1: cycle phases (duty/pause) delay
-     * RTC1 CC Channel 2: cycles count limit
+     * Input buttons
      */
+    memset(button_index, BUTTON_INDEX_NONE, sizeof(button_index));
+
+    for (uint8_t i = 0; i < BUTTON_COUNT; i++)
+    {
+#if CFG_BUTTON_DEBOUNCE_HW
+        /*
+         * IN channel event is routed to PPI only, no interrupt
+         */
+        nrfx_gpiote_in_config_t in_config_button =
+                NRFX_GPIOTE_CONFIG_IN_SENSE_TOGGLE(true);
+        in_config_button.pull = buttons_config[i].pull;
+
+        err_code = nrfx_gpiote_in_init(buttons_config[i].pin,
+                &in_config_button, NULL);
+        APP_ERROR_CHECK(err_code);
+#elif INPUT_MONITOR_USED
+        /*
+         * Button is configured by input monitor
+         */
+        input_monitor_ports[buttons_config[i].pin >> 5].mask |=
+                1UL << (buttons_config[i].pin & 0x1F);
+#else
+        nrfx_gpiote_in_config_t in_config_button =
+                NRFX_GPIOTE_CONFIG_IN_SENSE_TOGGLE(false);
+        in_config_button.pull = buttons_config[i].pull;
+
+        err_code = nrfx_gpiote_in_init(buttons_config[i].pin,
+                &in_config_button, gpio_event_handler);
+        APP_ERROR_CHECK(err_code);
+#endif
 
+        button_index[buttons_config[i].pin] = i;
+        buttons[i].state = BUTTON_STATE_IDLE;
+        buttons[i].level = nrf_gpio_pin_read(buttons_config[i].pin);
+        buttons[i].timer = (vtimer_t)VTIMER_INIT(button_timer_handler,
+                &buttons[i]);
+    }
+
+#if !CFG_PROBE_COUNTER_MODE
     /**
-     * TODO: PROBLEM - need to understand is enabled RTC instance or not
+     * Input probes
      */
+    nrfx_gpiote_in_config_t in_config_probe =
+            NRFX_GPIOTE_CONFIG_IN_SENSE_HITOLO(false);
+    in_config_probe.pull = NRF_GPIO_PIN_PULLUP;
 
     /**
-     * LED cycle duty phase delay
+     * Input probe 1
      */
-    nrfx_rtc_cc_set(&rtc1, 1,
-            current_counter +
-            RTC_MS_TO_COUNTER(CFG_LED_FLASH_DUTY_DELAY_MS), 
-            true);
+    err_code = nrfx_gpiote_in_init(IN_PROBE_1, &in_config_probe,
+            probe_event_handler);
+    APP_ERROR_CHECK(err_code);
 
     /**
-     * Set cycle limit
-     * (cycle duration * cycle count - pause delay of last cycle)
+     * Input probe 2
      */
-    nrfx_rtc_cc_set(&rtc1, 2,
-            current_counter +
-            RTC_MS_TO_COUNTER(CFG_LED_FLASH_CYCLE_DELAY_MS) * (count - 1) +
-                     RTC_MS_TO_COUNTER(CFG_LED_FLASH_DUTY_DELAY_MS),
-            true);
+    err_code = nrfx_gpiote_in_init(IN_PROBE_2, &in_config_probe,
+            probe_event_handler);
+    APP_ERROR_CHECK(err_code);
 
-    /**
-     * Switch LED to ON state
+#endif
+    /*
+     * Input interrupts
      */
-    nrfx_gpiote_out_clear(OUT_LED_0);
+#if CFG_BUTTON_DEBOUNCE_HW || !INPUT_MONITOR_USED
+    for (uint8_t i = 0; i < BUTTON_COUNT; i++)
+    {
+        nrfx_gpiote_in_event_enable(buttons_config[i].pin,
+                !CFG_BUTTON_DEBOUNCE_HW);
+    }
+#endif
+#if !CFG_PROBE_COUNTER_MODE
+    nrfx_gpiote_in_event_enable(IN_PROBE_1, true);
+    nrfx_gpiote_in_event_enable(IN_PROBE_2, true);
+#endif
 }
 
-
-static void gpio_event_handler(nrfx_gpiote_pin_t pin,
-        nrf_gpiote_polarity_t action)
+#if CFG_BUTTON_DEBOUNCE_HW
+/*
+ * @brief Function for initializing hardware button debounce.
+ *
+ * Every button edge clears and starts TIMER0 through own PPI channel.
+ * TIMER0 is stopped by COMPARE0 short, so it runs (and keeps HFCLK)
+ * only during debounce interval.
+ */
+static void button_debounce_init(void)
 {
     nrfx_err_t err_code;
-    bool pin_is_set = nrfx_gpiote_in_is_set(pin);
-    uint32_t current_counter;
-
-    NRF_LOG_INFO("GPIO: pin %d is %s", pin, (pin_is_set? "set": "clear"));
+    nrf_ppi_channel_t ppi_channel;
 
-    NRFX_CRITICAL_SECTION_ENTER();
+    nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG;
+    timer_config.frequency = NRF_TIMER_FREQ_31250Hz;
+    timer_config.mode = NRF_TIMER_MODE_TIMER;
+    timer_config.bit_width = NRF_TIMER_BIT_WIDTH_16;
 
-    switch (pin)
-    {
-        /*
-         * Button 0 input
-         */
-        case IN_BUTTON_0:
-            /*
-             * RTC1 CC Channel 0: long press delay
-             *
-             * When button pressed first time all compare counters 
-             * will started.
-             * Until debounce counter value will reached no any other
-             * events will processed. If input state wil not in LO state
-             * at end of debounce interval all counters will reset
-             * and processing will aborted.
-             * When LOTOHI event raised after debounce interval and along
-             * long press interval this means short press of button.
-             * When LOTOHI event raised after long press interval
-             * this means long press of button.
-             * 
-             * At end of event processing counter will be reset to zero.
-             * So nonzero value of counter means that event processing is
-             * in progress.
-             */
-            current_counter = nrfx_rtc_counter_get(&rtc1);
+    err_code = nrfx_timer_init(&timer0, &timer_config, timer0_event_handler);
+    APP_ERROR_CHECK(err_code);
 
-            if (current_counter == 0)
-            {
-                if (!pin_is_set)
-                {
-                    /*
-                     * First press of button
-                     * Arm long press delay counter
-                     */
-                    nrfx_rtc_cc_set(&rtc1, 0,
-                            RTC_MS_TO_COUNTER(CFG_BUTTON_LONG_PRESS_DELAY_MS), 
-                            true);
-                    nrfx_rtc_counter_clear(&rtc1);
-                    nrfx_rtc_enable(&rtc1);
-                }
-            }
-            else if (pin_is_set)
-            {
-                /*
-                 * Button released
-                 */
-                if (current_counter <
-                        RTC_MS_TO_COUNTER(CFG_BUTTON_DEBOUNCE_DELAY_MS))
-                {
-                    /**
-                     * False event - under debounce time, ignore
-                     */
-                    nrfx_rtc_disable(&rtc1);
-                    nrfx_rtc_counter_clear(&rtc1);
-                }
-                else if (current_counter < 
-                        RTC_MS_TO_COUNTER(CFG_BUTTON_LONG_PRESS_DELAY_MS))
-                {
-                    /*
-                     * Short press
-                     */
-                    nrfx_rtc_cc_disable(&rtc1, 0);
-
-                    led_blink(2);
-
-                    /**
-                     * TODO: This place for some application job
-                     */
-//                    saadc_sample();
-//                    temp_measure();
-                }
-            }
-            break;
-        case IN_PROBE_1:
-        case IN_PROBE_2:
-            led_blink(10);
-            break;
-        default:
-            break;
-    }
+    nrfx_timer_extended_compare(&timer0, NRF_TIMER_CC_CHANNEL0,
+            nrfx_timer_ms_to_ticks(&timer0, CFG_BUTTON_DEBOUNCE_DELAY_MS),
+            NRF_TIMER_SHORT_COMPARE0_STOP_MASK |
+                    NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK,
+            true);
 
-    NRFX_CRITICAL_SECTION_EXIT();
-}
+    for (uint8_t i = 0; i < BUTTON_COUNT; i++)
+    {
+        err_code = nrfx_ppi_channel_alloc(&ppi_channel);
+        APP_ERROR_CHECK(err_code);
 
-static void saadc_event_handler(nrfx_saadc_evt_t const *p_event) {}
+        err_code = nrfx_ppi_channel_assign(ppi_channel,
+                nrfx_gpiote_in_event_addr_get(buttons_config[i].pin),
+                nrfx_timer_task_address_get(&timer0, NRF_TIMER_TASK_CLEAR));
+        APP_ERROR_CHECK(err_code);
 
-static void temp_event_handler(int32_t value) {}
+        err_code = nrfx_ppi_channel_fork_assign(ppi_channel,
+                nrfx_timer_task_address_get(&timer0, NRF_TIMER_TASK_START));
+        APP_ERROR_CHECK(err_code);
 
-void clock_event_handler(nrfx_clock_evt_type_t event) {}
+        err_code = nrfx_ppi_channel_enable(ppi_channel);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+#endif
 
-void rtc0_event_handler(nrfx_rtc_int_type_t event)
+#if INPUT_MONITOR_USED
+/*
+ * @brief Function for initializing input monitor.
+ *
+ * Must be called after all other GPIOTE inputs are initialized.
+ */
+static void input_monitor_init(void)
 {
     nrfx_err_t err_code;
+    nrf_ppi_channel_t ppi_channel;
 
-    switch (event)
+    for (uint8_t port = 0; port < GPIO_COUNT; port++)
     {
+        input_monitor_port_t *p_port = &input_monitor_ports[port];
+
+        for (uint32_t bits = p_port->mask; bits; bits &= bits - 1)
+        {
+            nrfx_gpiote_pin_t pin =
+                    NRF_GPIO_PIN_MAP(port, __CLZ(__RBIT(bits)));
+            nrf_gpio_pin_pull_t pull = CFG_INPUT_MONITOR_PULL;
+
+            if (button_index[pin] != BUTTON_INDEX_NONE)
+            {
+                pull = buttons_config[button_index[pin]].pull;
+            }
+
+            nrf_gpio_cfg_input(pin, pull);
+        }
+
         /*
-         * Main loop cicle
+         * Pull resistors need some time to settle input levels
          */
-        case NRFX_RTC_INT_COMPARE0:
-            nrfx_rtc_counter_clear(&rtc0);
-            err_code = nrfx_rtc_cc_set(&rtc0, 0, 
-                    RTC_MS_TO_COUNTER(CFG_MAIN_LOOP_DELAY_MS), true);
-            APP_ERROR_CHECK(err_code);
-
-//            led_blink(3);
+        nrf_delay_us(10);
 
-            saadc_sample();
-            temp_measure();
-            break;
-        default:
-            break;
-    }
-}
+        p_port->snapshot = p_port->p_reg->IN & p_port->mask;
 
+        for (uint32_t bits = p_port->mask; bits; bits &= bits - 1)
+        {
+            uint32_t bit = __CLZ(__RBIT(bits));
 
-void rtc1_event_handler(nrfx_rtc_int_type_t event)
-{
-    nrfx_err_t err_code;
+            nrf_gpio_cfg_sense_set(NRF_GPIO_PIN_MAP(port, bit),
+                    ((p_port->snapshot >> bit) & 1)?
+                            NRF_GPIO_PIN_SENSE_LOW: NRF_GPIO_PIN_SENSE_HIGH);
+        }
 
-    NRFX_CRITICAL_SECTION_ENTER();
+        p_port->p_reg->DETECTMODE = GPIO_DETECTMODE_DETECTMODE_LDETECT;
+        p_port->p_reg->LATCH = p_port->mask;
+    }
 
     /*
-     * Current button state
+     * PORT event is handled by EGU3 instead of GPIOTE driver
      */
-    bool btn_is_set = nrfx_gpiote_in_is_set(IN_BUTTON_0);
-    uint32_t current_counter = nrfx_rtc_counter_get(&rtc1);
+    nrf_gpiote_int_disable(NRF_GPIOTE_INT_PORT_MASK);
 
-    switch (event)
+    nrf_egu_event_clear(NRF_EGU3, NRF_EGU_EVENT_TRIGGERED0);
+    nrf_egu_int_enable(NRF_EGU3, NRF_EGU_INT_TRIGGERED0);
+    NRFX_IRQ_PRIORITY_SET(SWI3_EGU3_IRQn, NRFX_GPIOTE_CONFIG_IRQ_PRIORITY);
+    NRFX_IRQ_ENABLE(SWI3_EGU3_IRQn);
+
+    err_code = nrfx_ppi_channel_alloc(&ppi_channel);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_ppi_channel_assign(ppi_channel,
+            nrf_gpiote_event_addr_get(NRF_GPIOTE_EVENTS_PORT),
+            nrf_egu_task_trigger_address_get(NRF_EGU3, 0));
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_ppi_channel_enable(ppi_channel);
+    APP_ERROR_CHECK(err_code);
+}
+#endif
+
+#if CFG_PROBE_COUNTER_MODE
+/*
+ * @brief Function for initializing probe pulse counters.
+ *
+ * Must be called after RTC1 is started.
+ */
+static void probe_counter_init(void)
+{
+    nrfx_err_t err_code;
+    nrf_ppi_channel_t ppi_channel;
+
+    for (uint8_t i = 0; i < PROBE_COUNT; i++)
     {
         /*
-         * Debounce interval
+         * IN channel event is routed to PPI only, no interrupt
          */
-        case NRFX_RTC_INT_COMPARE0:
-            /*
-             * Long press delay reached
-             */
-            if(!btn_is_set)
-            {
-                /**
-                 * Stop button long press counter
-                 */
-//                nrfx_rtc_cc_disable(&rtc1, 0);
+        nrfx_gpiote_in_config_t in_config_probe =
+                NRFX_GPIOTE_CONFIG_IN_SENSE_HITOLO(true);
+        in_config_probe.pull = NRF_GPIO_PIN_PULLUP;
 
-                led_blink(5);
+        err_code = nrfx_gpiote_in_init(probes_config[i].pin,
+                &in_config_probe, NULL);
+        APP_ERROR_CHECK(err_code);
 
-                /**
-                 * TODO: This place for some application job
-                 */
-            }
-            break;
-        case NRFX_RTC_INT_COMPARE1:
-            /*
-             * Toggle LED state and set counter of next phase
-             */
+        nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG;
+        timer_config.mode = NRF_TIMER_MODE_LOW_POWER_COUNTER;
+        timer_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
 
-            if(nrf_gpio_pin_out_read(OUT_LED_0))
-            {
-                /**
-                 * LED is off - going to duty phase
-                 */
-                nrfx_rtc_cc_set(&rtc1, 1,
-                        current_counter +
-                                RTC_MS_TO_COUNTER(CFG_LED_FLASH_DUTY_DELAY_MS), 
-                        true);
+        err_code = nrfx_timer_init(&probes_config[i].timer, &timer_config,
+                probe_timer_event_handler);
+        APP_ERROR_CHECK(err_code);
 
-                nrfx_gpiote_out_clear(OUT_LED_0);
-            }
-            else
-            {
-                /**
-                 * LED is on - going to passive phase
-                 */
-                nrfx_rtc_cc_set(&rtc1, 1,
-                        current_counter +
-                                (RTC_MS_TO_COUNTER(CFG_LED_FLASH_CYCLE_DELAY_MS) -
-                                RTC_MS_TO_COUNTER(CFG_LED_FLASH_DUTY_DELAY_MS)),
-                        true);
+        err_code = nrfx_ppi_channel_alloc(&ppi_channel);
+        APP_ERROR_CHECK(err_code);
 
-                nrfx_gpiote_out_set(OUT_LED_0);
-            }
-            break;
-        case NRFX_RTC_INT_COMPARE2:
-            /*
-             * LED blink finished - disable counter and switch led off
-             */
-            nrfx_rtc_disable(&rtc1);
-            nrfx_rtc_cc_disable(&rtc1, 1);
-            nrfx_rtc_cc_disable(&rtc1, 2);
-            nrfx_rtc_counter_clear(&rtc1);
+        err_code = nrfx_ppi_channel_assign(ppi_channel,
+                nrfx_gpiote_in_event_addr_get(probes_config[i].pin),
+                nrfx_timer_task_address_get(&probes_config[i].timer,
+                        NRF_TIMER_TASK_COUNT));
+        APP_ERROR_CHECK(err_code);
 
-            nrfx_gpiote_out_set(OUT_LED_0);
-            break;
-        default:
-            break;
+        err_code = nrfx_ppi_channel_enable(ppi_channel);
+        APP_ERROR_CHECK(err_code);
+
+        nrfx_timer_enable(&probes_config[i].timer);
+        nrfx_gpiote_in_event_enable(probes_config[i].pin, false);
+
+        probe_counts[i] = 0;
+        probe_rates[i] = 0;
     }
 
-    NRFX_CRITICAL_SECTION_EXIT();
+    vtimer_start(&probe_timer, PROBE_RATE_PERIOD, PROBE_RATE_PERIOD);
 }
+#endif
 
+#if CFG_ISR_STATS_ENABLED
+#if CFG_ISR_STATS_LATENCY
 /*
- * @brief Function for initializing the button handler module.
+ * Statistics timer does not generate interrupts, handler is required
+ * by driver
  */
-static void gpio_init(void)
+static void timer3_event_handler(nrf_timer_event_t event_type,
+        void *p_context)
+{
+}
+
+static void isr_stats_capture_connect(isr_stats_id_t id, uint32_t event)
 {
     nrfx_err_t err_code;
+    nrf_ppi_channel_t ppi_channel;
 
-    if (!nrfx_gpiote_is_init())
-    {
-        err_code = nrfx_gpiote_init();
-        APP_ERROR_CHECK(err_code);
-    }
+    err_code = nrfx_ppi_channel_alloc(&ppi_channel);
+    APP_ERROR_CHECK(err_code);
 
-    /**
-     * Input button 0
-     */
-    nrfx_gpiote_in_config_t in_config_button =
-            NRFX_GPIOTE_CONFIG_IN_SENSE_TOGGLE(false);
-    in_config_button.pull = NRF_GPIO_PIN_PULLUP;
+    err_code = nrfx_ppi_channel_assign(ppi_channel, event,
+            nrfx_timer_capture_task_address_get(&timer3,
+                    (nrf_timer_cc_channel_t)id));
+    APP_ERROR_CHECK(err_code);
 
-    err_code = nrfx_gpiote_in_init(IN_BUTTON_0, &in_config_button,
-            gpio_event_handler);
+    err_code = nrfx_ppi_channel_enable(ppi_channel);
     APP_ERROR_CHECK(err_code);
+}
+#endif
 
-    /**
-     * Input probes
+/*
+ * @brief Function for initializing interrupt handlers statistics.
+ */
+static void isr_stats_init(void)
+{
+    /*
+     * Enable DWT cycle counter
      */
-    nrfx_gpiote_in_config_t in_config_probe =
-            NRFX_GPIOTE_CONFIG_IN_SENSE_HITOLO(false);
-    in_config_probe.pull = NRF_GPIO_PIN_PULLUP;
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
-    /**
-     * Input probe 1
-     */
-    err_code = nrfx_gpiote_in_init(IN_PROBE_1, &in_config_probe,
-            gpio_event_handler);
-    APP_ERROR_CHECK(err_code);
+    memset(isr_stats, 0, sizeof(isr_stats));
 
-    /**
-     * Input probe 2
-     */
-    err_code = nrfx_gpiote_in_init(IN_PROBE_2, &in_config_probe,
-            gpio_event_handler);
+#if CFG_ISR_STATS_LATENCY
+    nrfx_err_t err_code;
+
+    nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG;
+    timer_config.frequency = NRF_TIMER_FREQ_16MHz;
+    timer_config.mode = NRF_TIMER_MODE_TIMER;
+    timer_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+
+    err_code = nrfx_timer_init(&timer3, &timer_config, timer3_event_handler);
     APP_ERROR_CHECK(err_code);
 
+#if CFG_BUTTON_DEBOUNCE_HW
+    isr_stats_capture_connect(ISR_STATS_INPUT,
+            nrfx_timer_event_address_get(&timer0, NRF_TIMER_EVENT_COMPARE0));
+#else
+    isr_stats_capture_connect(ISR_STATS_INPUT,
+            nrf_gpiote_event_addr_get(NRF_GPIOTE_EVENTS_PORT));
+#endif
+
+    isr_stats_capture_connect(ISR_STATS_RTC0,
+            nrfx_rtc_event_address_get(&rtc0, NRF_RTC_EVENT_COMPARE_0));
+
+    isr_stats_capture_connect(ISR_STATS_RTC1,
+            nrfx_rtc_event_address_get(&rtc1, NRF_RTC_EVENT_COMPARE_0));
+
+    nrfx_timer_enable(&timer3);
+#endif
+}
+#endif
+
+void saadc_init()
+{
+    nrfx_err_t err_code;
+
+    nrfx_saadc_config_t config = NRFX_SAADC_DEFAULT_CONFIG;
+#if CFG_SAADC_CONTINUOUS
     /*
-     * Output LED indicator
+     * In low power mode driver triggers START by itself on sampling
+     * request, which does not work with SAMPLE task triggered by PPI
      */
-    nrfx_gpiote_out_config_t out_config =
-            NRFX_GPIOTE_CONFIG_OUT_SIMPLE(true);
+    config.low_power_mode = false;
+#endif
     /*
-     * Output LED 0
+     * Driver is initialized again after capture, priority must be kept
      */
-    err_code = nrfx_gpiote_out_init(OUT_LED_0, &out_config);
+    config.interrupt_priority = irq_tier_priority_get(SAADC_IRQn);
+    err_code = nrfx_saadc_init(&config, saadc_event_handler);
     APP_ERROR_CHECK(err_code);
 
+    for (uint8_t ch = 0; ch < SAADC_CHANNEL_COUNT; ch++)
+    {
+        saadc_channel_config_t const *p_config = &saadc_channels_config[ch];
+        nrf_saadc_channel_config_t config_ch =
+                NRFX_SAADC_DEFAULT_CHANNEL_CONFIG_SE(p_config->pin_p);
+
+        NRFX_ASSERT((1u << p_config->oversample) <= CFG_SAADC_BUFFER_SIZE);
+        NRFX_ASSERT(config.oversample == NRF_SAADC_OVERSAMPLE_DISABLED ||
+                p_config->burst == NRF_SAADC_BURST_ENABLED);
+
+        if (p_config->pin_n != NRF_SAADC_INPUT_DISABLED)
+        {
+            config_ch.mode = NRF_SAADC_MODE_DIFFERENTIAL;
+            config_ch.pin_n = p_config->pin_n;
+        }
+        config_ch.gain = p_config->gain;
+        config_ch.acq_time = p_config->acq_time;
+        config_ch.burst = p_config->burst;
+
+        /*
+         * Scan order is channel number order, same as saadc_channel_id_t
+         */
+        err_code = nrfx_saadc_channel_init(ch, &config_ch);
+        APP_ERROR_CHECK(err_code);
+    }
+
+#if CFG_VDD_ALARM_ENABLED
+    vdd_alarm_apply();
+#endif
+
     /*
-     * Input interrupts
+     * Continuous acquisition is started on CALIBRATEDONE event
      */
-    nrfx_gpiote_in_event_enable(IN_BUTTON_0, true);
-    nrfx_gpiote_in_event_enable(IN_PROBE_1, true);
-    nrfx_gpiote_in_event_enable(IN_PROBE_2, true);
+    err_code = nrfx_saadc_calibrate_offset();
+    APP_ERROR_CHECK(err_code);
 }
 
-void saadc_init()
+#if CFG_SAADC_CONTINUOUS
+STATIC_ASSERT(CFG_SAADC_SAMPLE_RATE_HZ >= 8 &&
+        CFG_SAADC_SAMPLE_RATE_HZ <= 32768);
+
+/*
+ * @brief Function for initializing RTC2 TICK to SAADC SAMPLE trigger.
+ *
+ * RTC2 is enabled when SAADC buffers are set up.
+ */
+static void saadc_trigger_init(void)
 {
     nrfx_err_t err_code;
+    nrf_ppi_channel_t ppi_channel;
 
-    nrfx_saadc_config_t config = NRFX_SAADC_DEFAULT_CONFIG;
-    err_code = nrfx_saadc_init(&config, saadc_event_handler);
+    if (!nrfx_clock_lfclk_is_running()) {
+        nrfx_clock_lfclk_start();
+    }
+
+    nrfx_rtc_config_t rtc_config = NRFX_RTC_DEFAULT_CONFIG;
+    rtc_config.prescaler = RTC_FREQ_TO_PRESCALER(CFG_SAADC_SAMPLE_RATE_HZ);
+    err_code = nrfx_rtc_init(&rtc2, &rtc_config, rtc2_event_handler);
     APP_ERROR_CHECK(err_code);
 
-    nrf_saadc_channel_config_t config_ch_vdd =
-            NRFX_SAADC_DEFAULT_CHANNEL_CONFIG_SE(NRF_SAADC_INPUT_VDD);
-    config_ch_vdd.acq_time = NRF_SAADC_ACQTIME_20US;
-    config_ch_vdd.burst = NRF_SAADC_BURST_ENABLED;
+    /*
+     * TICK event without interrupt
+     */
+    nrfx_rtc_tick_enable(&rtc2, false);
+
+    err_code = nrfx_ppi_channel_alloc(&ppi_channel);
+    APP_ERROR_CHECK(err_code);
 
-    err_code = nrfx_saadc_channel_init(0, &config_ch_vdd);
+    err_code = nrfx_ppi_channel_assign(ppi_channel,
+            nrfx_rtc_event_address_get(&rtc2, NRF_RTC_EVENT_TICK),
+            nrfx_saadc_sample_task_get());
     APP_ERROR_CHECK(err_code);
 
-    err_code = nrfx_saadc_calibrate_offset();
+    err_code = nrfx_ppi_channel_enable(ppi_channel);
     APP_ERROR_CHECK(err_code);
 }
+#endif
 
 void temp_init()
 {
     nrfx_err_t err_code;
 
     nrfx_temp_config_t config = NRFX_TEMP_DEFAULT_CONFIG;
-    err_code = nrfx_temp_init(&config, NULL);
+    err_code = nrfx_temp_init(&config, temp_event_handler);
     APP_ERROR_CHECK(err_code);
 }
 
@@ -464,10 +5149,10 @@ void rtc0_init()
     }
 
     /*
-     * Init RTC frequency
+     * Init RTC frequency, no prescaler for exact tick periods
      */
     nrfx_rtc_config_t rtc_config = NRFX_RTC_DEFAULT_CONFIG;
-    rtc_config.prescaler = RTC_FREQ_TO_PRESCALER(RTC_COUNTER_FREQUENCY);
+    rtc_config.prescaler = 0;
     err_code = nrfx_rtc_init(&rtc0, &rtc_config, rtc0_event_handler);
     APP_ERROR_CHECK(err_code);
     nrfx_rtc_counter_clear(&rtc0);
@@ -488,10 +5173,20 @@ void rtc1_init()
      * Init RTC frequency
      */
     nrfx_rtc_config_t rtc_config = NRFX_RTC_DEFAULT_CONFIG;
-    rtc_config.prescaler = RTC_FREQ_TO_PRESCALER(RTC_COUNTER_FREQUENCY);
+    rtc_config.prescaler = 0;
     err_code = nrfx_rtc_init(&rtc1, &rtc_config, rtc1_event_handler);
     APP_ERROR_CHECK(err_code);
     nrfx_rtc_counter_clear(&rtc1);
+
+    /*
+     * Counter is free running, CC Channel 0 is used by virtual timers,
+     * CC Channel 1 and OVRFLW extend it to 64 bit timebase
+     */
+    err_code = nrfx_rtc_cc_set(&rtc1, TIMEBASE_HALF_CC,
+            RTC_COUNTER_HALF_RANGE, true);
+    APP_ERROR_CHECK(err_code);
+    nrfx_rtc_overflow_enable(&rtc1, true);
+    nrfx_rtc_enable(&rtc1);
 }
 
 /**
@@ -506,28 +5201,71 @@ int main(void)
 
     NRF_LOG_DEFAULT_BACKENDS_INIT();
 
+    err_code = NRF_ATFIFO_INIT(app_evt_fifo);
+    APP_ERROR_CHECK(err_code);
+
+#if CFG_ISR_STATS_ENABLED
+    isr_stats_init();
+#endif
+    sched_init();
+
     /*
      * Initialize peripherials
      */
     gpio_init();
 
-    saadc_init();
+    led_init();
+
+#if CFG_BUTTON_DEBOUNCE_HW
+    button_debounce_init();
+#endif
 
     temp_init();
 
     err_code = nrfx_clock_init(clock_event_handler);
     APP_ERROR_CHECK(err_code);
 
+#if CFG_SAADC_CONTINUOUS
+    saadc_trigger_init();
+#endif
+
+    saadc_init();
+
     /*
-     * RTC instance #0 - used for main loop cicle
+     * RTC instance #0 - used for periodic ticks
      */
-//    rtc0_init();
+    rtc0_init();
 
     /*
-     * RTC instance #1 - used for button 0 input
+     * RTC instance #1 - used for virtual timers
      */
     rtc1_init();
 
+#if CFG_PROBE_COUNTER_MODE
+    probe_counter_init();
+#endif
+
+#if CFG_CAPTURE_ENABLED
+    capture_init();
+#endif
+
+#if CFG_STATS_ENABLED
+    stats_init();
+#endif
+
+#if CFG_FLOG_ENABLED
+    flog_init();
+#endif
+
+#if INPUT_MONITOR_USED
+    input_monitor_init();
+#endif
+
+    /*
+     * Priorities from sdk_config.h are replaced by tiers
+     */
+    irq_tiers_apply();
+
     /**
      * Initalization complete
      */
@@ -546,28 +5284,20 @@ int main(void)
     
     NRF_LOG_INFO("System initialized, enter to main loop");
 
+    led_pattern_play(&led_pattern_hello, 1);
+
     /*
-     * Start RTC0 for main loop
+     * Start RTC0 periodic ticks
      */
-//    nrfx_rtc_counter_clear(&rtc0);
-//    err_code = nrfx_rtc_cc_set(&rtc0, 0, 
-//            RTC_MS_TO_COUNTER(CFG_MAIN_LOOP_DELAY_MS), true);
-//    APP_ERROR_CHECK(err_code);
-//
-//    nrfx_rtc_enable(&rtc0);
+    for (uint8_t i = 0; i < RTC0_TICK_COUNT; i++)
+    {
+        rtc0_tick_start((rtc0_tick_id_t)i);
+    }
+    nrfx_rtc_enable(&rtc0);
 
     /*
      * Main loop
      */
-    while (true)
-    {
-        if (!NRF_LOG_PROCESS())
-        { 
-            NRF_LOG_FLUSH();
-            __WFE();
-            __SEV();
-            __WFE();
-        }
-    }
+    sched_run();
 }
 /** @} */
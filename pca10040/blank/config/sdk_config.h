@@ -3175,21 +3175,21 @@
  
 
 #ifndef NRFX_SWI3_DISABLED
-#define NRFX_SWI3_DISABLED 0
+#define NRFX_SWI3_DISABLED 1
 #endif
 
 // <q> NRFX_SWI4_DISABLED  - Exclude SWI4 from being utilized by the driver
  
 
 #ifndef NRFX_SWI4_DISABLED
-#define NRFX_SWI4_DISABLED 0
+#define NRFX_SWI4_DISABLED 1
 #endif
 
 // <q> NRFX_SWI5_DISABLED  - Exclude SWI5 from being utilized by the driver
  
 
 #ifndef NRFX_SWI5_DISABLED
-#define NRFX_SWI5_DISABLED 0
+#define NRFX_SWI5_DISABLED 1
 #endif
 
 // <e> NRFX_SWI_CONFIG_LOG_ENABLED - Enables logging in the module.